@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+
+#define NIL      (-1)           // No entry
+
+// The four ARC lists
+#define T1 0                    // Resident pages seen once recently
+#define T2 1                    // Resident pages seen at least twice
+#define B1 2                    // Ghosts of pages evicted from T1
+#define B2 3                    // Ghosts of pages evicted from T2
+
+/*
+ * Adaptive Replacement Cache (Megiddo and Modha, FAST 2003).
+ *
+ * Resident pages are split between T1 (referenced once since they were
+ * loaded) and T2 (referenced more than once), both kept in LRU order. The
+ * ghost lists B1 and B2 remember the page numbers of pages recently evicted
+ * from T1 and T2. A fault on a page in B1 means T1 was too small, so the
+ * target size p of T1 grows; a fault on a page in B2 shrinks it. A scan
+ * only ever passes through T1, so it cannot flush the pages in T2.
+ *
+ * The simulator chooses the victim before it tells the algorithm which
+ * page is being loaded, so the paper's tie-break on |T1| == p for a page
+ * in B2 is not available to arc_evict(); p is adapted in arc_ref() instead.
+ *
+ * Every entry lives in one pool of 2 * memsize + 1 entries, and the ghost
+ * lists are found by page number through a pagemap, so each reference
+ * costs O(1) and nothing is allocated after arc_init().
+ */
+typedef struct __arc_entry_t {
+    addr_t vpn;                 // Virtual page number
+    int prev;                   // Next less recently used entry, or NIL
+    int next;                   // Next more recently used entry, or NIL
+    unsigned frame;             // Frame holding the page, if in T1 or T2
+    int list;                   // T1, T2, B1 or B2
+} arc_entry_t;
+
+typedef struct __arc_list_t {
+    int head;                   // LRU entry, or NIL if the list is empty
+    int tail;                   // MRU entry, or NIL if the list is empty
+    unsigned len;
+} arc_list_t;
+
+typedef struct __arc_t {
+    arc_entry_t *entries;       // Pool of 2 * memsize + 1 entries
+    int free_entry;             // Unused entries, linked through next
+    int *frame_entry;           // frame_entry[frame] = entry, or NIL
+    struct pagemap ghosts;      // vpn -> entry, for pages in B1 and B2
+    arc_list_t lists[4];
+    unsigned p;                 // Target size of T1
+} arc_t;
+
+
+// Removes entry e from its list
+static void arc_unlink(arc_t *arc, int e) {
+    arc_entry_t *entry = &arc->entries[e];
+    arc_list_t *l = &arc->lists[entry->list];
+
+    if (entry->prev == NIL) {
+        l->head = entry->next;
+    } else {
+        arc->entries[entry->prev].next = entry->next;
+    }
+    if (entry->next == NIL) {
+        l->tail = entry->prev;
+    } else {
+        arc->entries[entry->next].prev = entry->prev;
+    }
+    l->len--;
+}
+
+// Adds entry e to the MRU end of list
+static void arc_push(arc_t *arc, int e, int list) {
+    arc_entry_t *entry = &arc->entries[e];
+    arc_list_t *l = &arc->lists[list];
+
+    entry->list = list;
+    entry->prev = l->tail;
+    entry->next = NIL;
+    if (l->tail == NIL) {
+        l->head = e;
+    } else {
+        arc->entries[l->tail].next = e;
+    }
+    l->tail = e;
+    l->len++;
+}
+
+// Forgets the LRU page of ghost list
+static void arc_drop_ghost(arc_t *arc, int list) {
+    int e = arc->lists[list].head;
+
+    assert(e != NIL);
+    arc_unlink(arc, e);
+    pagemap_remove(&arc->ghosts, arc->entries[e].vpn);
+    arc->entries[e].next = arc->free_entry;
+    arc->free_entry = e;
+}
+
+
+/* Page to evict is chosen using the ARC algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ *
+ * The victim is the LRU page of T1 if T1 is larger than its target size,
+ * otherwise the LRU page of T2. Its page number moves to B1 or B2.
+ */
+int arc_evict(struct sim *s) {
+    arc_t *arc = s->alg_data;
+    int from, e;
+
+    if (arc->lists[T1].len > 0 &&
+            (arc->lists[T1].len > arc->p || arc->lists[T2].len == 0)) {
+        from = T1;
+    } else {
+        from = T2;
+    }
+    e = arc->lists[from].head;
+    assert(e != NIL);
+    s->evict_scan++;
+
+    arc_unlink(arc, e);
+    arc_push(arc, e, from == T1 ? B1 : B2);
+    *pagemap_insert(&arc->ghosts, arc->entries[e].vpn, NULL) = e;
+    arc->frame_entry[arc->entries[e].frame] = NIL;
+
+    return arc->entries[e].frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the ARC algorithm.
+ * Input: The page table entry for the page that is being accessed, and its
+ * virtual address.
+ */
+void arc_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+    arc_t *arc = s->alg_data;
+    unsigned frame = pte_frame(p);
+    addr_t vpn = vaddr >> s->page_shift;
+    unsigned c = s->memsize;
+    unsigned b1, b2, delta;
+    uint64_t *ghost;
+    int e;
+
+    if ((e = arc->frame_entry[frame]) != NIL) {
+        // Hit in T1 or T2: the page has now been seen twice
+        arc_unlink(arc, e);
+        arc_push(arc, e, T2);
+        return;
+    }
+
+    b1 = arc->lists[B1].len;
+    b2 = arc->lists[B2].len;
+    if ((ghost = pagemap_find(&arc->ghosts, vpn)) != NULL) {
+        // Fault on a ghost: adapt p, and the page goes straight to T2
+        e = (int)*ghost;
+        pagemap_remove(&arc->ghosts, vpn);
+        arc_unlink(arc, e);
+        if (arc->entries[e].list == B1) {
+            delta = (b1 >= b2) ? 1 : b2 / b1;
+            arc->p = (arc->p + delta > c) ? c : arc->p + delta;
+        } else {
+            delta = (b2 >= b1) ? 1 : b1 / b2;
+            arc->p = (arc->p < delta) ? 0 : arc->p - delta;
+        }
+        arc_push(arc, e, T2);
+    } else {
+        // A page not seen recently goes to T1
+        e = arc->free_entry;
+        assert(e != NIL);
+        arc->free_entry = arc->entries[e].next;
+        arc->entries[e].vpn = vpn;
+        arc_push(arc, e, T1);
+
+        // Keep |T1| + |B1| <= c and the whole directory within 2c
+        if (arc->lists[T1].len + arc->lists[B1].len > c &&
+                arc->lists[B1].len > 0) {
+            arc_drop_ghost(arc, B1);
+        }
+        while (arc->lists[T1].len + arc->lists[T2].len + arc->lists[B1].len
+                + arc->lists[B2].len > 2 * c) {
+            arc_drop_ghost(arc, arc->lists[B2].len > 0 ? B2 : B1);
+        }
+    }
+    arc->entries[e].frame = frame;
+    arc->frame_entry[frame] = e;
+}
+
+/* Initialize any data structures needed for this replacement
+ * algorithm.
+ */
+void arc_init(struct sim *s) {
+    unsigned m = s->memsize;
+    unsigned nentries = 2 * m + 1;
+    arc_t *arc;
+    char *mem;
+    unsigned i;
+
+    // One allocation for the struct and its arrays
+    mem = malloc(sizeof(arc_t) + nentries * sizeof(arc_entry_t)
+            + m * sizeof(int));
+    if (mem == NULL) {
+        perror("arc_init: malloc");
+        exit(1);
+    }
+    arc = (arc_t *)mem;
+    arc->entries = (arc_entry_t *)(mem + sizeof(arc_t));
+    arc->frame_entry = (int *)(arc->entries + nentries);
+
+    for (i = 0; i < nentries; i++) {
+        arc->entries[i].next = (i + 1 < nentries) ? (int)i + 1 : NIL;
+    }
+    arc->free_entry = 0;
+    for (i = 0; i < m; i++) {
+        arc->frame_entry[i] = NIL;
+    }
+    for (i = 0; i < 4; i++) {
+        arc->lists[i].head = arc->lists[i].tail = NIL;
+        arc->lists[i].len = 0;
+    }
+    pagemap_init(&arc->ghosts, m + 1);
+    arc->p = 0;
+
+    s->alg_data = arc;
+}
+
+void arc_destroy(struct sim *s) {
+    arc_t *arc = s->alg_data;
+    pagemap_destroy(&arc->ghosts);
+}
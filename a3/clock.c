@@ -3,14 +3,14 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include "sim.h"
 #include "pagetable.h"
 
 
-extern int memsize;
+typedef struct __clock_hand_t {
+    unsigned hand;              // Next frame the clock hand will look at
+} clock_hand_t;
 
-extern int debug;
-
-extern struct frame *coremap;
 
 /* Page to evict is chosen using the clock algorithm.
  * Returns the page frame number (which is also the index in the coremap)
@@ -20,16 +20,27 @@ extern struct frame *coremap;
  * a page with a reference bit set to 1, it clears the bit (i.e., sets it
  * to 0); when it finds a page with the reference bit set to 0, it chooses it as
  * its victim.
+ *
+ * The hand sweeps the coremap in order, so each reference bit it clears
+ * was set by a reference, and eviction is amortized O(1) per reference.
  */
 
-int clock_evict() {
+int clock_evict(struct sim *s) {
 
-    int pfn;
+    clock_hand_t *clk = s->alg_data;
+    pgtbl_entry_t **owner = s->coremap.pte;
+    unsigned pfn;
     for (;;) {
-        pfn = (int)(random() % memsize);            // try a random page
-        if (coremap[pfn].pte->frame & PG_REF) {
+        pfn = clk->hand;
+        clk->hand = (clk->hand + 1 == s->memsize) ? 0 : clk->hand + 1;
+        s->evict_scan++;
+        if (!frame_evictable(s, pfn)) {
+            // Another process's page, under local replacement
+            continue;
+        }
+        if (owner[pfn]->pte & PG_REF) {
             // Ref bit is set to 1, so set its REF bit to 0 and try again
-            coremap[pfn].pte->frame &= ~PG_REF;
+            owner[pfn]->pte &= ~PG_REF;
         } else {
             // Ref bit is set to 0. Victim found!
             return pfn;
@@ -46,16 +57,23 @@ int clock_evict() {
  * needed by the clock algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void clock_ref(pgtbl_entry_t *p) {
+void clock_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
 
-    p->frame |= PG_REF;
+    p->pte |= PG_REF;
 }
 
 /* Initialize any data structures needed for this replacement
  * algorithm.
  */
-void clock_init() {
-    // Nothing to initialize
+void clock_init(struct sim *s) {
+    clock_hand_t *clk = malloc(sizeof(clock_hand_t));
+    if (clk == NULL) {
+        perror("clock_init: malloc");
+        exit(1);
+    }
+
+    clk->hand = 0;
+    s->alg_data = clk;
 }
 
 
@@ -63,6 +81,8 @@ void clock_init() {
 
 
 /*
+ * Earlier versions, which tried random frames instead of sweeping a hand.
+ *
  * Textbook suggestion to prioritize non-dirty pages. Performance is slightly
  * worse than the version without proitizing non-dirty pages.
  */
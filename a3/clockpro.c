@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+
+#define NIL         (-1)        // No entry
+#define NEVER_USED  (-2)        // frame_entry of a frame not filled yet
+
+#define CP_HOT      0x1         // Hot page (otherwise cold)
+#define CP_TEST     0x2         // Cold page in its test period
+#define CP_RESIDENT 0x4         // Page is in memory (otherwise metadata only)
+
+/*
+ * CLOCK-Pro (Jiang, Chen and Zhang, USENIX 2005).
+ *
+ * Pages are hot (re-referenced within a short reuse distance) or cold.
+ * A newly loaded cold page starts a test period; if it is referenced again
+ * during the test period it becomes hot. Cold pages evicted during their
+ * test period are remembered as non-resident test pages, and a fault on
+ * one of those also makes the page hot.
+ *
+ *  - HAND_cold looks for a victim among the resident cold pages. A
+ *    referenced cold page in its test period is promoted to hot; one
+ *    outside its test period starts a new one. An unreferenced one is
+ *    evicted (and remembered if it is in its test period).
+ *  - HAND_hot demotes an unreferenced hot page to cold whenever there are
+ *    too many hot pages.
+ *  - HAND_test forgets the oldest non-resident pages, so that no more than
+ *    memsize of them are remembered.
+ *
+ * A fault on a remembered page means cold pages need more room, so the
+ * target number of resident cold pages grows; a test period ending without
+ * a re-reference shrinks it.
+ *
+ * The paper keeps all pages on one list, so HAND_cold must step over hot
+ * and non-resident pages and HAND_hot over cold ones, which costs O(memsize)
+ * per eviction when one kind dominates. Here each hand sweeps its own ring
+ * (hot, resident cold, non-resident test pages), so every step either
+ * clears a reference bit set by a reference or moves a page, and eviction
+ * is amortized O(1). A test period ends when HAND_hot has moved as many
+ * steps as there are hot pages since it started, which is when the single
+ * list's HAND_hot would have passed the page.
+ *
+ * Non-resident pages are identified by the address of their page table
+ * entry, which never changes during a simulation.
+ */
+typedef struct __cp_entry_t {
+    pgtbl_entry_t *page;        // The page this entry describes
+    int prev;                   // Neighbours on its ring
+    int next;
+    unsigned frame;             // Frame holding the page, if resident
+    unsigned char flags;        // CP_HOT, CP_TEST, CP_RESIDENT
+    unsigned long test_start;   // hot_moves when the test period started
+} cp_entry_t;
+
+// A ring of entries. The hand is at the oldest entry, and new entries are
+// inserted just behind it, so the hand reaches them last.
+typedef struct __cp_ring_t {
+    int hand;
+    unsigned len;
+} cp_ring_t;
+
+typedef struct __clockpro_t {
+    cp_entry_t *entries;        // Pool of 2 * memsize + 1 entries
+    int free_entry;             // Unused entries, linked through next
+    int *frame_entry;           // frame_entry[frame] = entry, NIL, NEVER_USED
+    struct pagemap nonres;      // Page -> entry, for non-resident test pages
+    cp_ring_t hot;              // Resident hot pages, swept by HAND_hot
+    cp_ring_t cold;             // Resident cold pages, swept by HAND_cold
+    cp_ring_t test;             // Non-resident test pages, swept by HAND_test
+    unsigned long hot_moves;    // Steps taken by HAND_hot so far
+    unsigned cold_target;       // Adaptive target for resident cold pages
+} clockpro_t;
+
+
+static int cp_alloc(clockpro_t *cp, pgtbl_entry_t *p, unsigned frame,
+        unsigned char flags) {
+    int e = cp->free_entry;
+    assert(e != NIL);
+    cp->free_entry = cp->entries[e].next;
+    cp->entries[e].page = p;
+    cp->entries[e].frame = frame;
+    cp->entries[e].flags = flags;
+    cp->entries[e].test_start = cp->hot_moves;
+    return e;
+}
+
+static void cp_free(clockpro_t *cp, int e) {
+    cp->entries[e].next = cp->free_entry;
+    cp->free_entry = e;
+}
+
+// Adds entry e to ring r as its newest entry
+static void cp_insert(clockpro_t *cp, cp_ring_t *r, int e) {
+    cp_entry_t *entries = cp->entries;
+
+    if (r->hand == NIL) {
+        entries[e].prev = entries[e].next = e;
+        r->hand = e;
+    } else {
+        entries[e].next = r->hand;
+        entries[e].prev = entries[r->hand].prev;
+        entries[entries[e].prev].next = e;
+        entries[r->hand].prev = e;
+    }
+    r->len++;
+}
+
+// Removes entry e from ring r, moving the hand along if it points at e
+static void cp_remove(clockpro_t *cp, cp_ring_t *r, int e) {
+    cp_entry_t *entries = cp->entries;
+    int next = entries[e].next;
+
+    if (next == e) {
+        r->hand = NIL;
+    } else {
+        if (r->hand == e) {
+            r->hand = next;
+        }
+        entries[entries[e].prev].next = next;
+        entries[next].prev = entries[e].prev;
+    }
+    r->len--;
+}
+
+// True if the test period of entry e is over
+static inline int cp_test_over(clockpro_t *cp, int e) {
+    return cp->hot_moves - cp->entries[e].test_start > cp->hot.len;
+}
+
+// A test period ended without a re-reference, so cold pages need less room
+static inline void cp_shrink_cold(clockpro_t *cp) {
+    if (cp->cold_target > 1) {
+        cp->cold_target--;
+    }
+}
+
+// Forgets the non-resident page in entry e
+static void cp_forget(clockpro_t *cp, int e) {
+    pagemap_remove(&cp->nonres, (uintptr_t)cp->entries[e].page);
+    cp_remove(cp, &cp->test, e);
+    cp_free(cp, e);
+}
+
+/* HAND_test: forgets the oldest non-resident pages while there are more than
+ * memsize of them, or their test periods are over.
+ */
+static void cp_run_hand_test(struct sim *s, clockpro_t *cp) {
+    while (cp->test.len > 0 &&
+            (cp->test.len > s->memsize || cp_test_over(cp, cp->test.hand))) {
+        cp_forget(cp, cp->test.hand);
+        cp_shrink_cold(cp);
+    }
+}
+
+/* HAND_hot: runs until it has demoted one hot page to cold.
+ */
+static void cp_run_hand_hot(clockpro_t *cp) {
+    for (;;) {
+        int e = cp->hot.hand;
+        cp_entry_t *entry = &cp->entries[e];
+        cp->hot_moves++;
+
+        if (entry->page->pte & PG_REF) {
+            entry->page->pte &= ~PG_REF;
+            cp->hot.hand = entry->next;
+        } else {
+            cp_remove(cp, &cp->hot, e);
+            entry->flags = CP_RESIDENT;
+            cp_insert(cp, &cp->cold, e);
+            return;
+        }
+    }
+}
+
+// Keeps the number of hot pages within what cold_target leaves over
+static void cp_balance(struct sim *s, clockpro_t *cp) {
+    while (cp->hot.len > s->memsize - cp->cold_target) {
+        cp_run_hand_hot(cp);
+    }
+}
+
+
+/* Page to evict is chosen using the CLOCK-Pro algorithm (HAND_cold).
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int clockpro_evict(struct sim *s) {
+    clockpro_t *cp = s->alg_data;
+    unsigned victim;
+
+    for (;;) {
+        int e = cp->cold.hand;
+        cp_entry_t *entry = &cp->entries[e];
+
+        s->evict_scan++;
+        if ((entry->flags & CP_TEST) && cp_test_over(cp, e)) {
+            entry->flags &= ~CP_TEST;
+            cp_shrink_cold(cp);
+        }
+
+        if (!(entry->page->pte & PG_REF)) {
+            break;
+        }
+        entry->page->pte &= ~PG_REF;
+        if (entry->flags & CP_TEST) {
+            // Re-referenced within its test period: promote to hot
+            cp_remove(cp, &cp->cold, e);
+            entry->flags = CP_HOT | CP_RESIDENT;
+            cp_insert(cp, &cp->hot, e);
+            cp_balance(s, cp);
+        } else {
+            // Start a new test period, as the newest cold page
+            entry->flags |= CP_TEST;
+            entry->test_start = cp->hot_moves;
+            cp->cold.hand = entry->next;
+        }
+    }
+
+    // Unreferenced resident cold page at the hand: this is the victim
+    int e = cp->cold.hand;
+    cp_entry_t *entry = &cp->entries[e];
+    victim = entry->frame;
+    cp_remove(cp, &cp->cold, e);
+    cp->frame_entry[victim] = NIL;
+    if (entry->flags & CP_TEST) {
+        // Remember it until its test period ends
+        entry->flags = CP_TEST;
+        *pagemap_insert(&cp->nonres, (uintptr_t)entry->page, NULL) = e;
+        cp_insert(cp, &cp->test, e);
+    } else {
+        cp_free(cp, e);
+    }
+    cp_run_hand_test(s, cp);
+
+    return victim;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the CLOCK-Pro algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void clockpro_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+    clockpro_t *cp = s->alg_data;
+    unsigned frame = pte_frame(p);
+    int first_fill = (cp->frame_entry[frame] == NEVER_USED);
+    int hot = 0;
+    uint64_t *old;
+    int e;
+
+    if (cp->frame_entry[frame] >= 0) {
+        // Hit: find_physpage() has already set the reference bit
+        return;
+    }
+
+    // The page has just been loaded into frame. The fault itself does not
+    // count as a re-reference.
+    p->pte &= ~PG_REF;
+
+    if ((old = pagemap_find(&cp->nonres, (uintptr_t)p)) != NULL) {
+        int old_e = (int)*old;
+        if (cp_test_over(cp, old_e)) {
+            cp_shrink_cold(cp);
+        } else {
+            // Its reuse distance is short enough to be hot, and cold pages
+            // need more room
+            hot = 1;
+            if (cp->cold_target < s->memsize - 1) {
+                cp->cold_target++;
+            }
+        }
+        cp_forget(cp, old_e);
+    } else if (first_fill && cp->hot.len < s->memsize - cp->cold_target) {
+        // While memory fills up, the first pages loaded start out hot
+        hot = 1;
+    }
+
+    if (hot) {
+        e = cp_alloc(cp, p, frame, CP_HOT | CP_RESIDENT);
+        cp_insert(cp, &cp->hot, e);
+    } else {
+        e = cp_alloc(cp, p, frame, CP_TEST | CP_RESIDENT);
+        cp_insert(cp, &cp->cold, e);
+    }
+    cp->frame_entry[frame] = e;
+    cp_balance(s, cp);
+}
+
+/* Initialize any data structures needed for this replacement
+ * algorithm.
+ */
+void clockpro_init(struct sim *s) {
+    unsigned m = s->memsize;
+    unsigned nentries = 2 * m + 1;
+    clockpro_t *cp;
+    char *mem;
+    unsigned i;
+
+    // One allocation for the struct and its arrays
+    mem = malloc(sizeof(clockpro_t) + nentries * sizeof(cp_entry_t)
+            + m * sizeof(int));
+    if (mem == NULL) {
+        perror("clockpro_init: malloc");
+        exit(1);
+    }
+    cp = (clockpro_t *)mem;
+    cp->entries = (cp_entry_t *)(mem + sizeof(clockpro_t));
+    cp->frame_entry = (int *)(cp->entries + nentries);
+
+    for (i = 0; i < nentries; i++) {
+        cp->entries[i].next = (i + 1 < nentries) ? (int)i + 1 : NIL;
+    }
+    cp->free_entry = 0;
+    for (i = 0; i < m; i++) {
+        cp->frame_entry[i] = NEVER_USED;
+    }
+    pagemap_init(&cp->nonres, m + 1);
+    cp->hot.hand = cp->cold.hand = cp->test.hand = NIL;
+    cp->hot.len = cp->cold.len = cp->test.len = 0;
+    cp->hot_moves = 0;
+    cp->cold_target = 1;
+
+    s->alg_data = cp;
+}
+
+void clockpro_destroy(struct sim *s) {
+    clockpro_t *cp = s->alg_data;
+    pagemap_destroy(&cp->nonres);
+}
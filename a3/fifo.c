@@ -3,23 +3,56 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include "sim.h"
 #include "pagetable.h"
 
 
-extern int memsize;
+#define NIL      (-1)           // End of the queue
+#define UNQUEUED (-2)           // next of a frame that is not in the queue
 
-extern int debug;
-
-extern struct frame *coremap;
-
-static int pfn;      // Oldest frame PFN to evict
+/*
+ * Frames are queued in the order their pages were loaded, in a singly
+ * linked list threaded through an array with one link per frame, as in
+ * lru.c. A frame joins the tail on the first reference after its page is
+ * loaded; references to a queued frame leave it where it is.
+ */
+typedef struct __fifo_t {
+    int head;                   // Oldest frame, or NIL if the queue is empty
+    int tail;                   // Newest frame, or NIL if the queue is empty
+    int next[];                 // Next newer frame, NIL or UNQUEUED
+} fifo_t;
 
 /* Page to evict is chosen using the fifo algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
+ *
+ * The victim is the oldest frame, or under local replacement the oldest
+ * frame of the faulting process.
  */
-int fifo_evict() {
-    pfn = (pfn + 1) % memsize;
+int fifo_evict(struct sim *s) {
+    fifo_t *fifo = s->alg_data;
+    int prev = NIL;
+    int pfn = fifo->head;
+
+    s->evict_scan++;
+    while (pfn != NIL && !frame_evictable(s, pfn)) {
+        prev = pfn;
+        pfn = fifo->next[pfn];
+        s->evict_scan++;
+    }
+    assert(pfn != NIL);
+
+    // Take it out of the queue
+    if (prev == NIL) {
+        fifo->head = fifo->next[pfn];
+    } else {
+        fifo->next[prev] = fifo->next[pfn];
+    }
+    if (fifo->tail == pfn) {
+        fifo->tail = prev;
+    }
+    fifo->next[pfn] = UNQUEUED;
+
 	return pfn;
 }
 
@@ -27,15 +60,37 @@ int fifo_evict() {
  * needed by the fifo algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void fifo_ref(pgtbl_entry_t *p) {
+void fifo_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+    fifo_t *fifo = s->alg_data;
+    int frame = pte_frame(p);
 
-	return;
+    // Queue the frame on the first reference to its page
+    if (fifo->next[frame] != UNQUEUED) {
+        return;
+    }
+    fifo->next[frame] = NIL;
+    if (fifo->tail == NIL) {
+        fifo->head = frame;
+    } else {
+        fifo->next[fifo->tail] = frame;
+    }
+    fifo->tail = frame;
 }
 
 /* Initialize any data structures needed for this
  * replacement algorithm
  */
-void fifo_init() {
-    // Initialize to -1, but will always be between [0, memsize-1]
-    pfn = -1;
+void fifo_init(struct sim *s) {
+    fifo_t *fifo = malloc(sizeof(fifo_t) + s->memsize * sizeof(int));
+    if (fifo == NULL) {
+        perror("fifo_init: malloc");
+        exit(1);
+    }
+
+    fifo->head = NIL;
+    fifo->tail = NIL;
+    for (int i = 0; i < s->memsize; i++) {
+        fifo->next[i] = UNQUEUED;
+    }
+    s->alg_data = fifo;
 }
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+
+
+#define GCLOCK_INIT 1           // Count given to a page when it is loaded
+#define GCLOCK_MAX  16          // Limit on a frame's count
+
+/*
+ * Generalized clock: instead of one reference bit, each frame has a count
+ * that is incremented on every hit (up to GCLOCK_MAX). The hand decrements
+ * counts as it sweeps and evicts the first frame whose count is zero, so
+ * frequently used pages survive several sweeps. Every decrement pays for
+ * an earlier increment, so eviction is amortized O(1) per reference.
+ */
+typedef struct __gclock_t {
+    unsigned hand;              // Next frame the clock hand will look at
+    unsigned char *count;       // count[frame]
+    pgtbl_entry_t **owner;      // owner[frame] = page the count belongs to
+} gclock_t;
+
+
+/* Page to evict is chosen using the generalized clock algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ */
+int gclock_evict(struct sim *s) {
+
+    gclock_t *gc = s->alg_data;
+    unsigned pfn;
+    for (;;) {
+        pfn = gc->hand;
+        gc->hand = (gc->hand + 1 == s->memsize) ? 0 : gc->hand + 1;
+        s->evict_scan++;
+        if (!frame_evictable(s, pfn)) {
+            // Another process's page, under local replacement
+            continue;
+        }
+        if (gc->count[pfn] > 0) {
+            gc->count[pfn]--;
+        } else {
+            gc->owner[pfn] = NULL;
+            return pfn;
+        }
+    }
+}
+
+
+/* This function is called on each access to a page to update any information
+ * needed by the gclock algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void gclock_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+
+    gclock_t *gc = s->alg_data;
+    unsigned frame = pte_frame(p);
+
+    if (gc->owner[frame] != p) {
+        // The page has just been loaded into this frame
+        gc->owner[frame] = p;
+        gc->count[frame] = GCLOCK_INIT;
+    } else if (gc->count[frame] < GCLOCK_MAX) {
+        gc->count[frame]++;
+    }
+}
+
+/* Initialize any data structures needed for this replacement
+ * algorithm.
+ */
+void gclock_init(struct sim *s) {
+    unsigned m = s->memsize;
+    char *mem;
+    gclock_t *gc;
+    unsigned i;
+
+    // One allocation for the struct and its arrays
+    mem = malloc(sizeof(gclock_t) + m * sizeof(pgtbl_entry_t *) + m);
+    if (mem == NULL) {
+        perror("gclock_init: malloc");
+        exit(1);
+    }
+    gc = (gclock_t *)mem;
+    gc->owner = (pgtbl_entry_t **)(mem + sizeof(gclock_t));
+    gc->count = (unsigned char *)(gc->owner + m);
+    gc->hand = 0;
+    for (i = 0; i < m; i++) {
+        gc->owner[i] = NULL;
+        gc->count[i] = 0;
+    }
+
+    s->alg_data = gc;
+}
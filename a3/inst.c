@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "inst.h"
+
+static const char *stage_names[INST_STAGES] = {
+	"find_physpage", "  evict", "  swap"
+};
+
+struct inst *inst_create(unsigned long interval, FILE *out) {
+	struct inst *inst = calloc(1, sizeof(struct inst));
+
+	if (inst == NULL) {
+		perror("Failed to allocate instrumentation");
+		exit(1);
+	}
+	inst->interval = interval;
+	inst->out = out;
+	inst->next_sample = interval;
+	return inst;
+}
+
+void inst_destroy(struct inst *inst) {
+	free(inst);
+}
+
+/* Forgets everything measured so far, when the warm-up of a marker-bounded
+ * trace ends.
+ */
+void inst_reset(struct inst *inst) {
+	memset(inst->cycles, 0, sizeof(inst->cycles));
+	memset(inst->calls, 0, sizeof(inst->calls));
+	memset(inst->scan_hist, 0, sizeof(inst->scan_hist));
+	memset(inst->last_cycles, 0, sizeof(inst->last_cycles));
+	inst->last_hits = inst->last_misses = 0;
+	inst->next_sample = inst->interval;
+}
+
+/* Prints the header of the time series.
+ */
+void inst_print_header(FILE *out) {
+	fprintf(out, "alg,refs,hits,misses,evictions,interval_miss_rate,"
+			"find_cycles,evict_cycles,swap_cycles\n");
+}
+
+/* Appends a row to the time series: the totals so far, the miss rate since
+ * the last sample and the cycles each stage took since then.
+ */
+void inst_sample(struct sim *s) {
+	struct inst *inst = s->inst;
+	unsigned long evictions = s->evict_clean_count + s->evict_dirty_count;
+	unsigned long hits = s->hit_count - inst->last_hits;
+	unsigned long misses = s->miss_count - inst->last_misses;
+	int i;
+
+	fprintf(inst->out, "%s,%lu,%lu,%lu,%lu,%.4f", s->alg->name,
+			s->ref_count, s->hit_count, s->miss_count, evictions,
+			hits + misses ? (double)misses / (hits + misses) * 100 : 0.0);
+	for (i = 0; i < INST_STAGES; i++) {
+		fprintf(inst->out, ",%lu",
+				(unsigned long)(inst->cycles[i] - inst->last_cycles[i]));
+		inst->last_cycles[i] = inst->cycles[i];
+	}
+	fprintf(inst->out, "\n");
+
+	inst->last_hits = s->hit_count;
+	inst->last_misses = s->miss_count;
+	inst->next_sample = s->ref_count + inst->interval;
+}
+
+/* Adds an eviction that examined scanned frames to the histogram.
+ */
+void inst_scan(struct inst *inst, unsigned long scanned) {
+	int b = 0;
+
+	while (scanned > 1 && b < INST_SCAN_BUCKETS - 1) {
+		scanned >>= 1;
+		b++;
+	}
+	inst->scan_hist[b]++;
+}
+
+/* Estimates how fast inst_now() counts, over a few milliseconds.
+ */
+static double inst_rate(void) {
+	static double rate;
+	double start, now;
+	uint64_t c0;
+
+	if (rate == 0) {
+		start = trace_now();
+		c0 = inst_now();
+		while ((now = trace_now()) - start < 0.01) {
+		}
+		rate = (inst_now() - c0) / (now - start);
+	}
+	return rate;
+}
+
+/* Finishes the time series and prints where the replay's time went, and
+ * the histogram of eviction scan lengths. decode_cycles is the time spent
+ * decoding the trace, which is shared by every simulation.
+ */
+void inst_print(struct sim *s, uint64_t decode_cycles) {
+	struct inst *inst = s->inst;
+	unsigned long evictions = 0;
+	double rate = inst_rate();
+	int i;
+
+	if (inst->interval > 0 && s->ref_count + inst->interval >
+			inst->next_sample) {
+		inst_sample(s);
+	}
+
+	printf("\nStage breakdown for %s (%.2f GHz counter):\n", s->alg->name,
+			rate / 1e9);
+	printf("%-16s %16s %12s %12s %12s\n", "stage", "cycles", "calls",
+			"cycles/call", "ms");
+	printf("%-16s %16lu %12s %12s %12.3f\n", "decode",
+			(unsigned long)decode_cycles, "-", "-", decode_cycles / rate * 1e3);
+	for (i = 0; i < INST_STAGES; i++) {
+		printf("%-16s %16lu %12lu %12.1f %12.3f\n", stage_names[i],
+				(unsigned long)inst->cycles[i], inst->calls[i],
+				inst->calls[i] ? (double)inst->cycles[i] / inst->calls[i] : 0.0,
+				inst->cycles[i] / rate * 1e3);
+	}
+
+	for (i = 0; i < INST_SCAN_BUCKETS; i++) {
+		evictions += inst->scan_hist[i];
+	}
+	if (evictions == 0) {
+		return;
+	}
+	printf("\nFrames examined per eviction:\n");
+	for (i = 0; i < INST_SCAN_BUCKETS; i++) {
+		if (inst->scan_hist[i] > 0) {
+			printf("%10lu-%-10lu %12lu %8.3f%%\n", 1UL << i, (2UL << i) - 1,
+					inst->scan_hist[i],
+					(double)inst->scan_hist[i] / evictions * 100);
+		}
+	}
+}
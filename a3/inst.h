@@ -0,0 +1,78 @@
+#ifndef __INST_H__
+#define __INST_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+struct sim;
+
+/* Instrumentation of the replay (sim -i).
+ *
+ * Stage timers count cycles of the time stamp counter spent in each stage
+ * of a reference. find_physpage includes the eviction and swap stages,
+ * which happen inside it. Every interval references the simulation's
+ * counters, and what they did since the last sample, are appended to a
+ * time series in CSV. Each eviction also adds the number of frames the
+ * algorithm examined to a histogram with power-of-two buckets.
+ *
+ * When instrumentation is off, s->inst is NULL and the replay takes its
+ * usual path, so the cost is one test per batch and one per eviction.
+ */
+enum inst_stage {
+	STAGE_FIND,                  // find_physpage(), and access_mem() around it
+	STAGE_EVICT,                 // The algorithm's evict function
+	STAGE_SWAP,                  // swap_pagein() and swap_pageout()
+	INST_STAGES
+};
+
+#define INST_SCAN_BUCKETS 32     // Bucket b holds scans of 2^b .. 2^(b+1)-1
+
+struct inst {
+	unsigned long interval;      // References between samples, or 0
+	FILE *out;                   // Time series output
+	unsigned long next_sample;   // ref_count of the next sample
+
+	uint64_t cycles[INST_STAGES];
+	unsigned long calls[INST_STAGES];
+	unsigned long scan_hist[INST_SCAN_BUCKETS];
+
+	// Counters at the last sample
+	uint64_t last_cycles[INST_STAGES];
+	unsigned long last_hits;
+	unsigned long last_misses;
+};
+
+/* Reads the time stamp counter, or a nanosecond clock where there is none.
+ */
+static inline uint64_t inst_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* Charges the cycles since start to stage.
+ */
+static inline void inst_add(struct inst *inst, enum inst_stage stage,
+		uint64_t start) {
+	inst->cycles[stage] += inst_now() - start;
+	inst->calls[stage]++;
+}
+
+extern struct inst *inst_create(unsigned long interval, FILE *out);
+extern void inst_destroy(struct inst *inst);
+extern void inst_reset(struct inst *inst);
+extern void inst_print_header(FILE *out);
+extern void inst_sample(struct sim *s);
+extern void inst_scan(struct inst *inst, unsigned long scanned);
+extern void inst_print(struct sim *s, uint64_t decode_cycles);
+
+#endif /* __INST_H__ */
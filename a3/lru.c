@@ -3,65 +3,83 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include "sim.h"
 #include "pagetable.h"
 
 
-extern int memsize;
-
-extern int debug;
-
-extern struct frame *coremap;
+#define NIL      (-1)           // End of the list
+#define UNLINKED (-2)           // prev of a node that is not in the list
 
+/*
+ * The LRU list is a doubly linked list of frames, threaded through an array
+ * with one node per frame. Links are frame numbers rather than pointers, and
+ * the node for frame f is always nodes[f], so no memory is allocated or
+ * freed after lru_init().
+ */
 typedef struct __node_t {
-    unsigned frame;
-    struct __node_t *next;
-    struct __node_t *prev;
+    int prev;                   // Next less recently used frame, NIL or UNLINKED
+    int next;                   // Next more recently used frame, or NIL
 } node_t;
 
 
-typedef struct __list_t {
-    unsigned size;
-    node_t *head;               // LRU
-    node_t *tail;               // MRU
-} list_t;
+typedef struct __lru_t {
+    int head;                   // LRU frame, or NIL if the list is empty
+    int tail;                   // MRU frame, or NIL if the list is empty
+    node_t nodes[];             // One node per frame
+} lru_t;
 
 
-list_t list;                    // A linked list
-node_t **map;                   // An array of pointers to nodes
+// Removes frame from the list
+static inline void lru_unlink(lru_t *lru, int frame) {
+    node_t *node = &lru->nodes[frame];
 
+    if (node->prev == NIL) {
+        lru->head = node->next;
+    } else {
+        lru->nodes[node->prev].next = node->next;
+    }
+    if (node->next == NIL) {
+        lru->tail = node->prev;
+    } else {
+        lru->nodes[node->next].prev = node->prev;
+    }
+    node->prev = UNLINKED;
+    node->next = NIL;
+}
 
+// Adds frame to the tail (the MRU side) of the list
+static inline void lru_push_tail(lru_t *lru, int frame) {
+    node_t *node = &lru->nodes[frame];
+
+    node->prev = lru->tail;
+    node->next = NIL;
+    if (lru->tail == NIL) {
+        lru->head = frame;
+    } else {
+        lru->nodes[lru->tail].next = frame;
+    }
+    lru->tail = frame;
+}
 
 
 /* Page to evict is chosen using the accurate LRU algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  *
- *
- * Keep a time stamp in each PTE, updated on each reference and
- * scan all the PTEs when choosing a victim to find the PTE with
- * the oldest timestamp.
+ * The victim is the frame at the head (the LRU side) of the list, or under
+ * local replacement the least recently used frame of the faulting process.
  */
-int lru_evict() {
-
-    // Get a pointer to the node we are removing from the list
-    node_t *victim = list.head;
-
-    // Either the list contains a single node, or more than one node
-    // Case 1: The list contains a single node
-    if (list.head == list.tail) {
-        list.head = list.tail = NULL;
-
-    // Case 2: The list contains at least two nodes
-    } else {
-        list.head = list.head->next;
-        list.head->prev = NULL;
+int lru_evict(struct sim *s) {
+    lru_t *lru = s->alg_data;
+    int pfn = lru->head;
+
+    s->evict_scan++;
+    while (pfn != NIL && !frame_evictable(s, pfn)) {
+        pfn = lru->nodes[pfn].next;
+        s->evict_scan++;
     }
-
-    // Get the frame to evict
-    int pfn = victim->frame;
-    map[pfn] = NULL;
-    free(victim);
-    list.size--;
+    assert(pfn != NIL);
+    lru_unlink(lru, pfn);
 
     return pfn;
 }
@@ -71,99 +89,45 @@ int lru_evict() {
  * needed by the lru algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void lru_ref(pgtbl_entry_t *p) {
+void lru_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+    lru_t *lru = s->alg_data;
 
     // Save the PFN from the incoming PTE
-    unsigned frame = (p->frame >> PAGE_SHIFT);
-
-    // Get a pointer to the target node, if it's in there
-    node_t *targ = map[frame];
-
-    if (targ == NULL) {
-        /*
-         * This is the first time we're referencing this frame, so create
-         * a new node and attach it to the back of the list (the MRU side).
-         */
-        node_t *node = malloc(sizeof(node_t));
-        node->frame = frame;
-        node->next = node->prev = NULL;
-
-        // Case 1: The list is empty
-        if (list.size == 0) {
-            list.head = node;
-            list.tail = node;
-
-        // Case 2: There is at least one node in the list. We add to the tail (MRU)
-        } else {
-            list.tail->next = node;
-            node->prev = list.tail;
-            list.tail = node;
-        }
-
-        // Store a point to this node
-        map[frame] = node;
-
-        list.size++;
+    int frame = pte_frame(p);
 
+    // Nothing to do if the frame is already the most recently used
+    if (frame == lru->tail) {
+        return;
+    }
 
-    } else {
-        /*
-         * This frame is being referenced again, so put this node to the
-         * tail of the linked list (the MRU side).
-         */
-
-        // Case 1: The list contains a single node
-        if (list.head == list.tail) {
-            // Nothing to update
-            ;
-
-        // Case 2: The list contains at least two node
-        } else {
-            // Case A: Target node is at the head
-            if (targ == list.head) {
-                list.head = list.head->next;
-                list.head->prev = NULL;
-                list.tail->next = targ;
-                targ->prev = list.tail;
-                targ->next = NULL;
-                list.tail = targ;
-
-            // Case B: Target node is at the tail
-            } else if (targ == list.tail) {
-                // Do nothing because the tail is the MRU side
-                ;
-
-            // Case C: There are at least three nodes and targ is not head or tail
-            } else {
-                // Unlink the target node from the list
-                targ->prev->next = targ->next;
-                targ->next->prev = targ->prev;
-
-                // Move targ to the MRU tail
-                targ->prev = list.tail;
-                targ->next = NULL;
-                list.tail->next = targ;
-                list.tail = targ;
-            }
-        }
+    // Otherwise move it (or, on its first reference, add it) to the MRU tail
+    if (lru->nodes[frame].prev != UNLINKED) {
+        lru_unlink(lru, frame);
     }
+    lru_push_tail(lru, frame);
 }
 
 
 /* Initialize any data structures needed for this
  * replacement algorithm
  */
-void lru_init() {
+void lru_init(struct sim *s) {
+
+    lru_t *lru = malloc(sizeof(lru_t) + s->memsize * sizeof(node_t));
+    if (lru == NULL) {
+        perror("lru_init: malloc");
+        exit(1);
+    }
 
-    list.size = 0;
-    list.head = NULL;
-    list.tail = NULL;
+    lru->head = NIL;
+    lru->tail = NIL;
 
-    map = malloc(memsize * sizeof(node_t *));
-    for (int i = 0; i < memsize; i++) {
-        map[i] = NULL;
+    for (int i = 0; i < s->memsize; i++) {
+        lru->nodes[i].prev = UNLINKED;
+        lru->nodes[i].next = NIL;
     }
 
+    s->alg_data = lru;
 }
 
 
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "stackdist.h"
+#include "trace.h"
+
+/* LRU miss-ratio curve in a single pass (Mattson's stack algorithm).
+ *
+ * LRU has the inclusion property: a memory of m frames holds exactly the m
+ * most recently used pages. So a reference hits in every memory of at least
+ * d frames, where d is its stack distance (see stackdist.h). A histogram of
+ * stack distances therefore gives the LRU miss count for every memory size
+ * at once.
+ */
+
+#define MRC_MIN_CAP 1024
+
+typedef struct __mrc_t {
+    struct stackdist sd;
+    unsigned long *hist;        // hist[d] = references with stack distance d
+    size_t hist_cap;
+    unsigned long cold;         // First references to a page
+    unsigned long refs;
+} mrc_t;
+
+
+/* Records a reference to virtual page vpn.
+ */
+static void mrc_ref(mrc_t *mrc, uint64_t vpn) {
+    size_t d = stackdist_ref(&mrc->sd, vpn);
+
+    if (d > 0) {
+        if (d >= mrc->hist_cap) {
+            size_t old = mrc->hist_cap;
+            while (d >= mrc->hist_cap) {
+                mrc->hist_cap *= 2;
+            }
+            mrc->hist = realloc(mrc->hist, mrc->hist_cap * sizeof(unsigned long));
+            if (mrc->hist == NULL) {
+                perror("lru-mrc: realloc");
+                exit(1);
+            }
+            memset(mrc->hist + old, 0, (mrc->hist_cap - old) * sizeof(unsigned long));
+        }
+        mrc->hist[d]++;
+    } else {
+        mrc->cold++;
+    }
+    mrc->refs++;
+}
+
+/* Computes the LRU miss-ratio curve of the whole trace in one pass and
+ * prints it as CSV. If step is 0, every memory size from 1 frame up to the
+ * trace's footprint is printed; otherwise sizes first..last in steps of step.
+ */
+void run_lru_mrc(struct trace_reader *tr, unsigned first, unsigned last,
+        unsigned step) {
+    mrc_t mrc;
+    const trace_rec_t *recs;
+    size_t i, n, k;
+    int phase = WINDOW_WARMUP;
+    unsigned long misses;
+    unsigned m;
+    int shift = sim_page_shift();
+
+    memset(&mrc, 0, sizeof(mrc));
+    stackdist_init(&mrc.sd);
+    mrc.hist_cap = MRC_MIN_CAP;
+    mrc.hist = calloc(mrc.hist_cap, sizeof(unsigned long));
+    if (mrc.hist == NULL) {
+        perror("lru-mrc: calloc");
+        exit(1);
+    }
+
+    while (phase != WINDOW_DONE && (n = trace_next(tr, &recs)) > 0) {
+        for (; n > 0; recs += k, n -= k) {
+            int prev = phase;
+            k = trace_window(tr, recs, n, &phase);
+            if (phase == WINDOW_DONE) {
+                break;
+            }
+            if (phase != prev) {
+                // Warm-up references leave their pages on the stack, but
+                // their distances are not counted
+                memset(mrc.hist, 0, mrc.hist_cap * sizeof(unsigned long));
+                mrc.cold = 0;
+                mrc.refs = 0;
+            }
+            for (i = 0; i < k; i++) {
+                mrc_ref(&mrc, TREC_VADDR(recs[i]) >> shift);
+            }
+        }
+    }
+
+    if (step == 0) {
+        first = 1;
+        last = mrc.sd.last.count;
+        step = 1;
+    }
+
+    // misses(m) = references whose stack distance exceeds m
+    printf("memsize,references,hits,misses,hit_rate\n");
+    misses = mrc.refs;
+    for (m = 1; m <= last && m >= 1; m++) {
+        if (m < mrc.hist_cap) {
+            misses -= mrc.hist[m];
+        }
+        if (m >= first && (m - first) % step == 0) {
+            printf("%u,%lu,%lu,%lu,%.4f\n", m, mrc.refs, mrc.refs - misses,
+                    misses, mrc.refs ?
+                    (double)(mrc.refs - misses) / mrc.refs * 100 : 0.0);
+        }
+    }
+    fprintf(stderr, "Footprint: %lu pages, %lu cold misses\n",
+            (unsigned long)mrc.sd.last.count, mrc.cold);
+
+    stackdist_destroy(&mrc.sd);
+    free(mrc.hist);
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+
+#define NEVER UINT64_MAX        // Next use of a page that is not used again
+
+/*
+ * Belady's optimal algorithm evicts the page whose next use is furthest in
+ * the future. Rather than scanning ahead in the trace on every eviction, we
+ * compute next[i], the position of the next reference to the same page as
+ * reference i, in one backward pass over the trace. The resident pages are
+ * kept in a max-heap of frames keyed by the next use of the page in each
+ * frame, so eviction is O(log M).
+ */
+typedef struct __opt_t {
+    uint64_t *next;             // next[i] = next use of the page at trace[i]
+    uint64_t *key;              // key[frame] = next use of page in frame
+    unsigned *heap;             // Max-heap of frames, ordered by key
+    int *heap_pos;              // heap_pos[frame] = index in heap, or -1
+    unsigned size;              // Number of frames in the heap
+} opt_t;
+
+
+static void heap_swap(opt_t *opt, unsigned i, unsigned j) {
+    unsigned fi = opt->heap[i];
+    unsigned fj = opt->heap[j];
+    opt->heap[i] = fj;
+    opt->heap[j] = fi;
+    opt->heap_pos[fj] = i;
+    opt->heap_pos[fi] = j;
+}
+
+static void heap_up(opt_t *opt, unsigned i) {
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+        if (opt->key[opt->heap[parent]] >= opt->key[opt->heap[i]]) {
+            break;
+        }
+        heap_swap(opt, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(opt_t *opt, unsigned i) {
+    for (;;) {
+        unsigned largest = i;
+        unsigned left = 2 * i + 1;
+        unsigned right = 2 * i + 2;
+        if (left < opt->size &&
+                opt->key[opt->heap[left]] > opt->key[opt->heap[largest]]) {
+            largest = left;
+        }
+        if (right < opt->size &&
+                opt->key[opt->heap[right]] > opt->key[opt->heap[largest]]) {
+            largest = right;
+        }
+        if (largest == i) {
+            break;
+        }
+        heap_swap(opt, i, largest);
+        i = largest;
+    }
+}
+
+
+/* Page to evict is chosen using the optimal (aka MIN) algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ *
+ * Under local replacement only the faulting process's frames qualify, so
+ * the heap is scanned for the best of them, in O(M).
+ */
+int opt_evict(struct sim *s) {
+    opt_t *opt = s->alg_data;
+    unsigned i, pos = 0;
+
+    // The root of the heap is the frame whose page is needed last
+    if (s->evict_asid >= 0) {
+        int found = 0;
+        for (i = 0; i < opt->size; i++) {
+            if (frame_evictable(s, opt->heap[i]) && (!found ||
+                    opt->key[opt->heap[i]] > opt->key[opt->heap[pos]])) {
+                pos = i;
+                found = 1;
+            }
+        }
+        assert(found);
+        s->evict_scan += opt->size;
+    } else {
+        s->evict_scan++;
+    }
+    unsigned pfn = opt->heap[pos];
+
+    opt->size--;
+    if (pos < opt->size) {
+        heap_swap(opt, pos, opt->size);
+        heap_down(opt, pos);
+        heap_up(opt, pos);
+    }
+    opt->heap_pos[pfn] = -1;
+
+    return pfn;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the opt algorithm.
+ * Input: The page table entry for the page that is being accessed.
+ */
+void opt_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+    opt_t *opt = s->alg_data;
+    unsigned frame = pte_frame(p);
+
+    opt->key[frame] = opt->next[s->trace_pos];
+
+    if (opt->heap_pos[frame] == -1) {
+        // First reference since the page was brought into this frame
+        opt->heap[opt->size] = frame;
+        opt->heap_pos[frame] = opt->size;
+        opt->size++;
+        heap_up(opt, opt->size - 1);
+    } else {
+        // The key was this reference's position, so it can only grow
+        heap_up(opt, opt->heap_pos[frame]);
+    }
+}
+
+/* Initializes any data structures needed for this
+ * replacement algorithm.
+ */
+void opt_init(struct sim *s) {
+    size_t n = s->trace_len;
+    unsigned m = s->memsize;
+    struct pagemap later;
+    opt_t *opt;
+    char *mem;
+    size_t i;
+
+    // One allocation for the struct and all of its arrays, so that
+    // sim_destroy() can free it
+    mem = malloc(sizeof(opt_t) + n * sizeof(uint64_t) + m * sizeof(uint64_t)
+            + m * sizeof(unsigned) + m * sizeof(int));
+    if (mem == NULL) {
+        perror("opt_init: malloc");
+        exit(1);
+    }
+    opt = (opt_t *)mem;
+    opt->next = (uint64_t *)(mem + sizeof(opt_t));
+    opt->key = opt->next + n;
+    opt->heap = (unsigned *)(opt->key + m);
+    opt->heap_pos = (int *)(opt->heap + m);
+    opt->size = 0;
+    for (i = 0; i < m; i++) {
+        opt->heap_pos[i] = -1;
+    }
+
+    // Walk the trace backwards, remembering the latest position seen for
+    // each page, which is the next use of that page for earlier references.
+    pagemap_init(&later, 1024);
+    for (i = n; i-- > 0; ) {
+        int found;
+        uint64_t *pos = pagemap_insert(&later,
+                TREC_VADDR(s->trace[i]) >> s->page_shift, &found);
+        opt->next[i] = found ? *pos : NEVER;
+        *pos = i;
+    }
+    pagemap_destroy(&later);
+
+    s->alg_data = opt;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pagemap.h"
+
+// Fibonacci hashing: multiply by 2^64/phi and keep the top bits
+static inline size_t pagemap_hash(struct pagemap *pm, uint64_t key) {
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> pm->shift);
+}
+
+static void pagemap_alloc(struct pagemap *pm, size_t cap) {
+	size_t i;
+
+	pm->cap = cap;
+	pm->count = 0;
+	pm->shift = 64;
+	while (cap > 1) {
+		pm->shift--;
+		cap >>= 1;
+	}
+	pm->keys = malloc(pm->cap * sizeof(uint64_t));
+	pm->vals = malloc(pm->cap * sizeof(uint64_t));
+	if (pm->keys == NULL || pm->vals == NULL) {
+		perror("pagemap: malloc");
+		exit(1);
+	}
+	for (i = 0; i < pm->cap; i++) {
+		pm->keys[i] = PAGEMAP_EMPTY;
+	}
+}
+
+/* Initializes an empty map with room for about cap entries before growing.
+ */
+void pagemap_init(struct pagemap *pm, size_t cap) {
+	size_t c = 16;
+	while (c < cap + cap / 3) {
+		c <<= 1;
+	}
+	pagemap_alloc(pm, c);
+}
+
+void pagemap_destroy(struct pagemap *pm) {
+	free(pm->keys);
+	free(pm->vals);
+	memset(pm, 0, sizeof(*pm));
+}
+
+/* Returns a pointer to the value stored for key, or NULL if there is none.
+ */
+uint64_t *pagemap_find(struct pagemap *pm, uint64_t key) {
+	size_t mask = pm->cap - 1;
+	size_t i = pagemap_hash(pm, key);
+
+	while (pm->keys[i] != PAGEMAP_EMPTY) {
+		if (pm->keys[i] == key) {
+			return &pm->vals[i];
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+// Doubles the table, rehashing every entry
+static void pagemap_grow(struct pagemap *pm) {
+	struct pagemap old = *pm;
+	size_t i;
+
+	pagemap_alloc(pm, old.cap * 2);
+	for (i = 0; i < old.cap; i++) {
+		if (old.keys[i] != PAGEMAP_EMPTY) {
+			*pagemap_insert(pm, old.keys[i], NULL) = old.vals[i];
+		}
+	}
+	free(old.keys);
+	free(old.vals);
+}
+
+/* Returns a pointer to the value stored for key, adding the key first if
+ * it is not in the map (in which case the value is 0).
+ * If found is not NULL, it is set to true iff the key was already present.
+ * The pointer is only valid until the next insertion.
+ */
+uint64_t *pagemap_insert(struct pagemap *pm, uint64_t key, int *found) {
+	size_t mask, i;
+
+	if ((pm->count + 1) * 4 > pm->cap * 3) {
+		pagemap_grow(pm);
+	}
+	mask = pm->cap - 1;
+	i = pagemap_hash(pm, key);
+	while (pm->keys[i] != PAGEMAP_EMPTY) {
+		if (pm->keys[i] == key) {
+			if (found != NULL) {
+				*found = 1;
+			}
+			return &pm->vals[i];
+		}
+		i = (i + 1) & mask;
+	}
+	pm->keys[i] = key;
+	pm->vals[i] = 0;
+	pm->count++;
+	if (found != NULL) {
+		*found = 0;
+	}
+	return &pm->vals[i];
+}
+
+/* Removes key from the map. Returns true iff it was present.
+ * Later entries in the same probe run are shifted back into the hole, so
+ * lookups never need tombstones.
+ */
+int pagemap_remove(struct pagemap *pm, uint64_t key) {
+	size_t mask = pm->cap - 1;
+	size_t i = pagemap_hash(pm, key);
+	size_t j;
+
+	while (pm->keys[i] != key) {
+		if (pm->keys[i] == PAGEMAP_EMPTY) {
+			return 0;
+		}
+		i = (i + 1) & mask;
+	}
+
+	for (j = (i + 1) & mask; pm->keys[j] != PAGEMAP_EMPTY; j = (j + 1) & mask) {
+		// The entry at j may move to the hole at i only if its home slot
+		// is not cyclically within (i, j]
+		size_t home = pagemap_hash(pm, pm->keys[j]);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			pm->keys[i] = pm->keys[j];
+			pm->vals[i] = pm->vals[j];
+			i = j;
+		}
+	}
+	pm->keys[i] = PAGEMAP_EMPTY;
+	pm->count--;
+	return 1;
+}
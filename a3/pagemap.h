@@ -0,0 +1,27 @@
+#ifndef __PAGEMAP_H__
+#define __PAGEMAP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* A hash map from virtual page numbers to 64-bit values, used by the trace
+ * analyses to remember per-page state. It uses open addressing with linear
+ * probing in a power-of-two table that doubles when it is 3/4 full.
+ */
+#define PAGEMAP_EMPTY    UINT64_MAX   // Key value marking an unused slot
+
+struct pagemap {
+	uint64_t *keys;
+	uint64_t *vals;
+	size_t cap;                       // Number of slots, a power of two
+	size_t count;                     // Number of slots in use
+	int shift;                        // 64 - log2(cap), for hashing
+};
+
+extern void pagemap_init(struct pagemap *pm, size_t cap);
+extern void pagemap_destroy(struct pagemap *pm);
+extern uint64_t *pagemap_find(struct pagemap *pm, uint64_t key);
+extern uint64_t *pagemap_insert(struct pagemap *pm, uint64_t key, int *found);
+extern int pagemap_remove(struct pagemap *pm, uint64_t key);
+
+#endif /* __PAGEMAP_H__ */
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "pagesample.h"
+
+// The part of a page's hash compared with the threshold
+static inline uint64_t sample_hash(uint64_t vpn) {
+    return page_hash(vpn) >> (64 - SAMPLE_HASH_BITS);
+}
+
+static void heap_push(struct pagesample *ps, uint64_t vpn) {
+    uint64_t h = sample_hash(vpn);
+    size_t i = ps->nheap++;
+
+    while (i > 0 && sample_hash(ps->heap[(i - 1) / 2]) < h) {
+        ps->heap[i] = ps->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    ps->heap[i] = vpn;
+}
+
+static uint64_t heap_pop(struct pagesample *ps) {
+    uint64_t top = ps->heap[0];
+    uint64_t last = ps->heap[--ps->nheap];
+    uint64_t h = sample_hash(last);
+    size_t i = 0, c;
+
+    while ((c = 2 * i + 1) < ps->nheap) {
+        if (c + 1 < ps->nheap &&
+                sample_hash(ps->heap[c + 1]) > sample_hash(ps->heap[c])) {
+            c++;
+        }
+        if (sample_hash(ps->heap[c]) <= h) {
+            break;
+        }
+        ps->heap[i] = ps->heap[c];
+        i = c;
+    }
+    if (ps->nheap > 0) {
+        ps->heap[i] = last;
+    }
+    return top;
+}
+
+/* Initializes a sample that uses at most about budget bytes.
+ */
+void pagesample_init(struct pagesample *ps, size_t budget) {
+    stackdist_init(&ps->sd);
+    ps->threshold = SAMPLE_HASH_RANGE;
+    ps->max_pages = budget / SAMPLE_BYTES_PER_PAGE;
+    if (ps->max_pages < 1) {
+        ps->max_pages = 1;
+    }
+    ps->heap = malloc((ps->max_pages + 1) * sizeof(uint64_t));
+    ps->nheap = 0;
+    if (ps->heap == NULL) {
+        perror("pagesample: malloc");
+        exit(1);
+    }
+    if (ps->max_pages < SAMPLE_MIN_PAGES) {
+        fprintf(stderr, "Warning: the budget leaves room for only %zu sampled pages; "
+                "estimates are unreliable with fewer than %d\n",
+                ps->max_pages, SAMPLE_MIN_PAGES);
+    }
+}
+
+void pagesample_destroy(struct pagesample *ps) {
+    stackdist_destroy(&ps->sd);
+    free(ps->heap);
+    ps->heap = NULL;
+}
+
+/* Records a reference to virtual page vpn. Returns true if the page is
+ * sampled, in which case *dist is set to the estimated stack distance of
+ * the reference in the whole trace, or 0 if it is the page's first.
+ * The rate may drop afterwards, to make room for a new page.
+ */
+int pagesample_ref(struct pagesample *ps, uint64_t vpn, double *dist) {
+    size_t n = ps->sd.last.count;
+    size_t d;
+
+    if (sample_hash(vpn) >= ps->threshold) {
+        return 0;
+    }
+    d = stackdist_ref(&ps->sd, vpn);
+    *dist = d / pagesample_rate(ps);
+    if (ps->sd.last.count == n) {
+        return 1;
+    }
+
+    heap_push(ps, vpn);
+    while (ps->sd.last.count > ps->max_pages) {
+        // Lower the threshold to the largest hash, and drop every page
+        // that has it
+        ps->threshold = sample_hash(ps->heap[0]);
+        while (ps->nheap > 0 && sample_hash(ps->heap[0]) >= ps->threshold) {
+            stackdist_remove(&ps->sd, heap_pop(ps));
+        }
+    }
+    return 1;
+}
+
+/* Makes a histogram of sampled distances, and the cold first references
+ * beside it, add up to the refs references of the whole trace, which the
+ * sample's weights need not. A shortfall is mostly the references of a
+ * very hot page outside the sample, so it goes to the smallest distances,
+ * hist[0] (SHARDS-adj). An excess, from such a page inside the sample, is
+ * spread over the whole histogram by scaling it down to refs - *cold.
+ */
+void pagesample_adjust(double *hist, size_t nbins, double *cold,
+        unsigned long refs) {
+    double total = 0;
+    size_t b;
+
+    if (*cold > refs) {
+        *cold = refs;
+    }
+    for (b = 0; b < nbins; b++) {
+        total += hist[b];
+    }
+    if (*cold + total <= refs) {
+        hist[0] += refs - *cold - total;
+    } else {
+        for (b = 0; b < nbins; b++) {
+            hist[b] *= (refs - *cold) / total;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef __PAGESAMPLE_H__
+#define __PAGESAMPLE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stackdist.h"
+
+/* Spatially hashed sampling of pages, in a fixed amount of memory.
+ *
+ * A page is sampled iff its hash falls below a threshold, so every
+ * reference to a sampled page is seen and the stack distances among the
+ * sampled pages, divided by the sampling rate, estimate the distances in
+ * the whole trace (Waldspurger et al., "Efficient MRC Construction with
+ * SHARDS", FAST 2015). The rate starts at 1 and is lowered whenever more
+ * than max_pages pages would be sampled, by dropping the pages with the
+ * largest hashes, so the memory used never depends on the trace.
+ */
+#define SAMPLE_HASH_BITS      24
+#define SAMPLE_HASH_RANGE     ((uint64_t)1 << SAMPLE_HASH_BITS)
+#define SAMPLE_BYTES_PER_PAGE 80    // Map, tree and heap, at their largest
+#define SAMPLE_MIN_PAGES      4096  // Fewer and the estimates are unreliable
+
+struct pagesample {
+    struct stackdist sd;        // Distances among the sampled pages
+    uint64_t threshold;         // Hashes below it are sampled
+    size_t max_pages;
+    uint64_t *heap;             // Max-heap of the sampled pages by hash
+    size_t nheap;
+};
+
+/* Mixes the bits of a page number (the splitmix64 finalizer), so that any
+ * range of the result is a uniform hash of it.
+ */
+static inline uint64_t page_hash(uint64_t vpn) {
+    uint64_t z = vpn + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* The fraction of pages sampled.
+ */
+static inline double pagesample_rate(struct pagesample *ps) {
+    return (double)ps->threshold / SAMPLE_HASH_RANGE;
+}
+
+extern void pagesample_init(struct pagesample *ps, size_t budget);
+extern void pagesample_destroy(struct pagesample *ps);
+extern int pagesample_ref(struct pagesample *ps, uint64_t vpn, double *dist);
+extern void pagesample_adjust(double *hist, size_t nbins, double *cold,
+        unsigned long refs);
+
+#endif /* __PAGESAMPLE_H__ */
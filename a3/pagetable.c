@@ -2,17 +2,15 @@
 #include <string.h>
 #include "sim.h"
 #include "pagetable.h"
-
-// The top-level page table (also known as the 'page directory')
-pgdir_entry_t pgdir[PTRS_PER_PGDIR];
-
-// Counters for various events.
-// Your code must increment these when the related events occur.
-int hit_count = 0;
-int miss_count = 0;
-int ref_count = 0;
-int evict_clean_count = 0;
-int evict_dirty_count = 0;
+#include "tlb.h"
+#include "inst.h"
+
+// Returns the byte offset in the swapfile of the entry's copy on swap,
+// or INVALID_SWAP if it has none
+static off_t pte_swap_off(struct sim *s, pgtbl_entry_t *pte) {
+	off_t slot = pte_swap_slot(pte);
+	return (slot == INVALID_SWAP) ? INVALID_SWAP : slot * s->pagesize;
+}
 
 /*
  * Allocates a frame to be used for the virtual page represented by p.
@@ -23,99 +21,261 @@ int evict_dirty_count = 0;
  *
  * Counters for evictions should be updated appropriately in this function.
  */
-int allocate_frame(pgtbl_entry_t *p) {
-	int i;
-	int frame = -1;
-	for(i = 0; i < memsize; i++) {
-		if(!coremap[i].in_use) {
-			frame = i;
-			break;
+int allocate_frame(struct sim *s, pgtbl_entry_t *p, addr_t vpn,
+		unsigned asid) {
+	struct coremap *coremap = &s->coremap;
+	int frame;
+	if (s->nfree > 0) {
+		// Take a free frame from the top of the stack
+		frame = s->free_frames[--s->nfree];
+	} else { // Memory is full.
+		// Under local replacement the process gives up one of its own
+		// pages, unless it has none yet
+		if (s->local && s->procs[asid].resident > 0) {
+			s->evict_asid = asid;
 		}
-	}
-	if(frame == -1) { // Didn't find a free page.
 		// Call replacement algorithm's evict function to select victim
-		frame = evict_fcn();    // returns a 32 bit unsigned int PFN
+		if (s->inst == NULL) {
+			frame = s->alg->evict(s);    // returns a 32 bit unsigned int PFN
+		} else {
+			unsigned long scanned = s->evict_scan;
+			uint64_t start = inst_now();
+			frame = s->alg->evict(s);
+			inst_add(s->inst, STAGE_EVICT, start);
+			inst_scan(s->inst, s->evict_scan - scanned);
+		}
+		s->evict_asid = -1;
+		assert(s->procs[asid].resident == 0 || !s->local ||
+				coremap->asid[frame] == asid);
 
 		// All frames were in use, so victim frame must hold some page
 		// Write victim page to swap, if needed, and update pagetable
 		// IMPLEMENTATION NEEDED
 
         // Get the victim PTE from the evicted frame
-        pgtbl_entry_t *pte = coremap[frame].pte;
+        pgtbl_entry_t *pte = coremap->pte[frame];
+
+        // Shoot down any cached translation for the victim page
+        if (s->itlb != NULL) {
+            tlb_shootdown(s->itlb, coremap->vpn[frame]);
+            tlb_shootdown(s->dtlb, coremap->vpn[frame]);
+        }
 
         // Check if the dirty bit has been set to 1 (i.e. page has been modified)
-        if (pte->frame & PG_DIRTY) {
-            int swap_offset;
-            if ((swap_offset = swap_pageout(frame, pte->swap_off)) == INVALID_SWAP) {
+        if (pte->pte & PG_DIRTY) {
+            off_t swap_offset;
+            uint64_t start = s->inst != NULL ? inst_now() : 0;
+            if ((swap_offset = swap_pageout(s, frame, pte_swap_off(s, pte))) == INVALID_SWAP) {
                 fprintf(stderr, "allocate_frame INVALID_SWAP");
                 exit(EXIT_FAILURE);
             }
-            // Set the victim PTE's swap_off, and set the ONSWAP bit to 1
-            pte->swap_off = swap_offset;
-            pte->frame |= PG_ONSWAP;        // PG_ONSWAP 1000
+            if (s->inst != NULL) {
+                inst_add(s->inst, STAGE_SWAP, start);
+            }
+            // Set the victim PTE's swap slot, and set the ONSWAP bit to 1
+            pte_set_swap_slot(pte, swap_offset / s->pagesize);
+            pte->pte |= PG_ONSWAP;        // PG_ONSWAP 1000
 
             // Update counter
-            evict_dirty_count++;
+            s->evict_dirty_count++;
         } else {
             // Update counter
-            evict_clean_count++;
+            s->evict_clean_count++;
         }
 
         // No longer dirty because it's being stored
-        pte->frame &= ~PG_DIRTY;
+        pte->pte &= ~PG_DIRTY;
         // Set the victim PTE's frame to be invalid (i.e. ~PG_VALID = 11..0)
         // since this physical frame is no longer pointing to this PTE
-        pte->frame &= ~PG_VALID;    // sets the lowest-order bit to 0
+        pte->pte &= ~PG_VALID;    // sets the lowest-order bit to 0
+
+        s->procs[coremap->asid[frame]].resident--;
+        s->procs[coremap->asid[frame]].evict_count++;
 	}
 
 	// Record information for virtual page that will now be stored in frame
-	coremap[frame].in_use = 1;
-	coremap[frame].pte = p;
+	coremap->pte[frame] = p;
+	coremap->vpn[frame] = vpn;
+	coremap->asid[frame] = asid;
+	s->procs[asid].resident++;
 
 	return frame;
 }
 
+// Rounds n up to a whole number of cache lines
+static size_t cache_lines(size_t n) {
+	return (n + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
 /*
- * Initializes the top-level pagetable.
+ * Allocates the coremap's arrays, all unused, in one cache-line-aligned
+ * block.
+ */
+void init_coremap(struct sim *s) {
+	size_t pte_bytes = cache_lines(s->memsize * sizeof(pgtbl_entry_t *));
+	size_t vpn_bytes = cache_lines(s->memsize * sizeof(addr_t));
+	void *mem;
+
+	if (s->memsize > PTE_MAX_FRAMES) {
+		fprintf(stderr, "Error: at most %u frames fit in a page table entry\n",
+				PTE_MAX_FRAMES);
+		exit(1);
+	}
+	if (posix_memalign(&mem, CACHE_LINE, coremap_bytes(s)) != 0) {
+		perror("Failed to allocate coremap");
+		exit(1);
+	}
+	memset(mem, 0, coremap_bytes(s));
+	s->coremap.pte = mem;
+	s->coremap.vpn = (addr_t *)((char *)mem + pte_bytes);
+	s->coremap.asid = (unsigned char *)mem + pte_bytes + vpn_bytes;
+	s->coremap.flags = s->coremap.asid + cache_lines(s->memsize);
+}
+
+void free_coremap(struct sim *s) {
+	free(s->coremap.pte);
+}
+
+// Returns the bytes of the coremap's arrays
+size_t coremap_bytes(struct sim *s) {
+	return cache_lines(s->memsize * sizeof(pgtbl_entry_t *))
+			+ cache_lines(s->memsize * sizeof(addr_t))
+			+ 2 * cache_lines(s->memsize);
+}
+
+/*
+ * Initializes the page table layout and the table of processes.
  * This function is called once at the start of the simulation.
- * For the simulation, there is a single "process" whose reference trace is
- * being simulated, so there is just one top-level page table (page directory).
- * To keep things simple, we use a global array of 'page directory entries'.
+ * Every process in the trace (there is just one, ASID 0, unless the trace
+ * is tagged with pids) has its own top-level page table (page directory),
+ * in s->procs[asid].pgdir. As in a real OS, where it would be allocated
+ * as part of process creation, it is created when the process first runs.
+ * All processes share the simulation's physical memory and coremap.
  *
- * In a real OS, each process would have its own page directory, which would
- * need to be allocated and initialized as part of process creation.
+ * The shape of the table comes from sim_pt_levels and sim_huge_pages. Two
+ * levels give the original layout for 36-bit addresses; more give a radix
+ * tree of 512-entry tables, where the lowest level is left out if the
+ * leaves map 2 MiB pages.
  */
-void init_pagetable() {
-	int i;
-	// Set all entries in top-level pagetable to 0, which ensures valid
-	// bits are all 0 initially.
-	for (i=0; i < PTRS_PER_PGDIR; i++) {
-		pgdir[i].pde = 0;
+void init_pagetable(struct sim *s) {
+	int l, n;
+
+	if (sim_pt_levels == 2 && !sim_huge_pages) {
+		s->pt_levels = 2;
+		s->pt_shift[0] = PGDIR_SHIFT;
+		s->pt_entries[0] = PTRS_PER_PGDIR;
+		s->pt_shift[1] = PAGE_SHIFT;
+		s->pt_entries[1] = PTRS_PER_PGTBL;
+		s->page_shift = PAGE_SHIFT;
+	} else {
+		n = sim_huge_pages ? sim_pt_levels - 1 : sim_pt_levels;
+		assert(n >= 2 && n <= PT_MAX_LEVELS);
+		s->pt_levels = n;
+		s->page_shift = sim_page_shift();
+		for (l = 0; l < n; l++) {
+			s->pt_shift[l] = s->page_shift + PT_RADIX_BITS * (n - 1 - l);
+			s->pt_entries[l] = 1 << PT_RADIX_BITS;
+		}
+	}
+	s->va_bits = s->pt_shift[0] + __builtin_ctz(s->pt_entries[0]);
+	for (l = 0; l < s->pt_levels; l++) {
+		s->pt_tables[l] = 0;
 	}
+
+	if ((s->procs = calloc(MAX_ASIDS, sizeof(struct process))) == NULL) {
+		perror("Failed to allocate processes");
+		exit(1);
+	}
+	s->nprocs = 0;
 }
 
-// For simulation, we get second-level pagetables from ordinary memory
-pgdir_entry_t init_second_level() {
-	int i;
+// Returns the page directory of process asid, creating it on its first
+// reference
+static pgdir_entry_t *proc_pgdir(struct sim *s, unsigned asid) {
+	struct process *proc = &s->procs[asid];
+
+	if (proc->pgdir == NULL) {
+		// Set all entries in top-level pagetable to 0, which ensures valid
+		// bits are all 0 initially.
+		proc->pgdir = calloc(s->pt_entries[0], sizeof(pgdir_entry_t));
+		if (proc->pgdir == NULL) {
+			perror("Failed to allocate page directory");
+			exit(1);
+		}
+		s->pt_tables[0]++;
+		if (asid >= s->nprocs) {
+			s->nprocs = asid + 1;
+		}
+	}
+	return proc->pgdir;
+}
+
+// Index into the table at level for vaddr
+static inline unsigned pt_index(struct sim *s, addr_t vaddr, int level) {
+	return (vaddr >> s->pt_shift[level]) & (s->pt_entries[level] - 1);
+}
+
+// Bytes in one table at level
+static size_t pt_table_bytes(struct sim *s, int level) {
+	return (size_t)s->pt_entries[level] * (level == s->pt_levels - 1 ?
+			sizeof(pgtbl_entry_t) : sizeof(pgdir_entry_t));
+}
+
+// Frees a table below the page directory and every table under it
+static void free_table(struct sim *s, pgdir_entry_t *table, int level) {
+	unsigned i;
+	if (level < s->pt_levels - 1) {
+		for (i = 0; i < s->pt_entries[level]; i++) {
+			if (table[i].pde & PG_VALID) {
+				free_table(s, (pgdir_entry_t *)(table[i].pde & PAGE_MASK),
+						level + 1);
+			}
+		}
+	}
+	free(table);
+}
+
+/*
+ * Frees every process's top-level pagetable and every lower-level pagetable
+ * under it.
+ */
+void free_pagetable(struct sim *s) {
+	unsigned i, asid;
+	for (asid = 0; asid < s->nprocs; asid++) {
+		pgdir_entry_t *pgdir = s->procs[asid].pgdir;
+		if (pgdir == NULL) {
+			continue;
+		}
+		for (i=0; i < s->pt_entries[0]; i++) {
+			if (pgdir[i].pde & PG_VALID) {
+				free_table(s, (pgdir_entry_t *)(pgdir[i].pde & PAGE_MASK), 1);
+			}
+		}
+		free(pgdir);
+	}
+	free(s->procs);
+	s->procs = NULL;
+}
+
+// For simulation, we get lower-level pagetables from ordinary memory.
+// Returns a valid directory entry pointing to a new, empty table for level.
+pgdir_entry_t init_lower_level(struct sim *s, int level) {
 	pgdir_entry_t new_entry;
-	pgtbl_entry_t *pgtbl;
+	void *table;
 
 	// Allocating aligned memory ensures the low bits in the pointer must
 	// be zero, so we can use them to store our status bits, like PG_VALID
-	if (posix_memalign((void **)&pgtbl, PAGE_SIZE,
-			   PTRS_PER_PGTBL*sizeof(pgtbl_entry_t)) != 0) {
+	if (posix_memalign(&table, PAGE_SIZE, pt_table_bytes(s, level)) != 0) {
 		perror("Failed to allocate aligned memory for page table");
 		exit(1);
 	}
 
-	// Initialize all entries in second-level pagetable
-	for (i=0; i < PTRS_PER_PGTBL; i++) {
-		pgtbl[i].frame = 0; // sets all bits, including valid, to zero
-		pgtbl[i].swap_off = INVALID_SWAP;
-	}
+	// Zeroed entries are invalid, and leaf entries also have no swap slot
+	memset(table, 0, pt_table_bytes(s, level));
+	s->pt_tables[level]++;
 
 	// Mark the new page directory entry as valid
-	new_entry.pde = (uintptr_t)pgtbl | PG_VALID;
+	new_entry.pde = (uintptr_t)table | PG_VALID;
 
 	return new_entry;
 }
@@ -130,18 +290,51 @@ pgdir_entry_t init_second_level() {
  * page frame to help with error checking.
  *
  */
-void init_frame(int frame, addr_t vaddr) {
+void init_frame(struct sim *s, int frame, addr_t vaddr) {
 	// Calculate pointer to start of frame in (simulated) physical memory
-	char *mem_ptr = &physmem[frame*SIMPAGESIZE];
+	char *mem_ptr = &s->physmem[(size_t)frame * s->pagesize];
 	// Calculate pointer to location in page where we keep the vaddr
     addr_t *vaddr_ptr = (addr_t *)(mem_ptr + sizeof(int));
 
-	memset(mem_ptr, 0, SIMPAGESIZE); // zero-fill the frame
-	*vaddr_ptr = vaddr;             // record the vaddr for error checking
+	// zero-fill the frame, unless it has never held a page: physmem is
+	// anonymous memory, which the kernel hands out already zeroed, and the
+	// first touch of each of its pages is the only write it needs
+	if (s->coremap.flags[frame] & FRAME_USED) {
+		memset(mem_ptr, 0, s->pagesize);
+	}
+	s->coremap.flags[frame] |= FRAME_USED;
+	*vaddr_ptr = frame_tag(s, vaddr); // record the vaddr for error checking
 
 	return;
 }
 
+// Walks process asid's page table down to the entry for vaddr
+static pgtbl_entry_t *pt_walk(struct sim *s, unsigned asid, addr_t vaddr) {
+	pgdir_entry_t *table = proc_pgdir(s, asid);
+	int level;
+
+	if ((vaddr >> s->va_bits) != 0) {
+		fprintf(stderr, "Error: address %lx does not fit a %d-level page table; use more levels (-L)\n",
+				vaddr, s->pt_levels);
+		exit(1);
+	}
+
+	// Use a slice of the vaddr's bits as the index at each level. Each
+	// directory entry "is a pointer to a page table" one level down;
+	// missing tables are created on the way, so only the parts of the
+	// address space that are used take up memory.
+	for (level = 0; level < s->pt_levels - 1; level++) {
+		pgdir_entry_t *pde = &table[pt_index(s, vaddr, level)];
+		if ((pde->pde & PG_VALID) == 0) {
+			*pde = init_lower_level(s, level + 1);
+		}
+		table = (pgdir_entry_t *)(pde->pde & PAGE_MASK); // lower 12 bits are 0
+	}
+
+	// The leaf tables are arrays of page table entries
+	return &((pgtbl_entry_t *)table)[pt_index(s, vaddr, level)];
+}
+
 /*
  * Locate the physical frame number for the given vaddr using the page table.
  *
@@ -155,92 +348,108 @@ void init_frame(int frame, addr_t vaddr) {
  * Counters for hit, miss and reference events should be incremented in
  * this function.
  */
-char *find_physpage(addr_t vaddr, char type) {
-
-    /* Note: Assume vaddr is 36 bits. Offset is 12 bits. 24 bits VPN.
-     * PGDIR_SHIFT shifts 24 bits, so 36 - 24 = top 12 bits of vaddr
-     * Thus the 24 bit VPN has top 12 bits for PDIndex and lower 12
-     * bits for PTIndex.
-     */
-
-    // Get the page directory index from the vaddr
-	unsigned pd_idx = PGDIR_INDEX(vaddr); // top 12 bits of vaddr
-
-    // Check if the 2nd-level page table is invalid, if so, initialize
-    if ((pgdir[pd_idx].pde & PG_VALID) == 0) {
-        pgdir[pd_idx] = init_second_level();
-    }
-
-	// Use vaddr to get index into 2nd-level page table and initialize 'pte'
-    /* Note: pgdir[pd_inx].pde "is a pointer to a page table" and
-     * "the page tables are arrays of page table entries"
-     */
-    pgtbl_entry_t *pgtbl = (pgtbl_entry_t *)(pgdir[pd_idx].pde & PAGE_MASK); // lower 12 bits are 0
-    pgtbl_entry_t *pte = &pgtbl[PGTBL_INDEX(vaddr)];
-    // pgtbl_entry_t *pte = PGTBL_INDEX(vaddr) + pgtbl; // equivalent to above
+char *find_physpage(struct sim *s, addr_t vaddr, char type) {
+	// The ASID is part of the page number, so pages of different processes
+	// never match in the TLB or the replacement algorithm
+	unsigned asid = VADDR_ASID(vaddr);
+	struct process *proc = &s->procs[asid];
+	addr_t vpn = vaddr >> s->page_shift;
+	// Instruction fetches go through the I-TLB, data accesses the D-TLB
+	struct tlb *tlb = (type == 'I') ? s->itlb : s->dtlb;
+	pgtbl_entry_t *pte = NULL;
+	int walked = 0;
+
+	// A TLB hit gives the entry of a resident page without a walk
+	if (tlb != NULL) {
+		pte = tlb_lookup(tlb, vpn);
+	}
+	if (pte == NULL) {
+		pte = pt_walk(s, asid, VADDR_ADDR(vaddr));
+		walked = 1;
+	}
 
 
 	// Check if pte is valid or not, on swap or not, and handle appropriately
-    if ((pte->frame & PG_VALID) == 0) {
+    if ((pte->pte & PG_VALID) == 0) {
         // PTE is invalid (physical frame is not holding vpage)
-        int frame = allocate_frame(pte);    // only the PFN (no status bits)
+        int frame = allocate_frame(s, pte, vpn, asid); // only the PFN (no status bits)
 
         // Check if the PTE is not on swap
-        if ((pte->frame & PG_ONSWAP) == 0) {
+        if ((pte->pte & PG_ONSWAP) == 0) {
             // then we need to initialize the new frame
-            init_frame(frame, vaddr);
-            pte->frame = (frame << PAGE_SHIFT);
+            init_frame(s, frame, vaddr);
+            pte_set_frame(pte, frame);
 
             // Set dirty bit on invalid and not on swap no matter the type
-            pte->frame |= PG_DIRTY;
+            pte->pte |= PG_DIRTY;
 
             // Frame should now be valid, dirty, referenced, not on swap
 
         } else {
             // then the PTE is on swap, so swap in the page
-            if ((swap_pagein(frame, pte->swap_off)) != 0) {
+            uint64_t start = s->inst != NULL ? inst_now() : 0;
+            if ((swap_pagein(s, frame, pte_swap_off(s, pte))) != 0) {
                 perror("swap_pagein");
                 exit(EXIT_FAILURE);
             }
+            if (s->inst != NULL) {
+                inst_add(s->inst, STAGE_SWAP, start);
+            }
+            s->coremap.flags[frame] |= FRAME_USED;
             // New frame so all status bits are zero
-            pte->frame = (frame << PAGE_SHIFT);
+            pte_set_frame(pte, frame);
 
             // Frame should now be valid, not dirty, referenced, not on swap
         }
 
-        miss_count++;
+        s->miss_count++;
+        proc->miss_count++;
 
     } else {
         // The physical frame is holding this vpage
-        hit_count++;
+        s->hit_count++;
+        proc->hit_count++;
     }
 
 	// Make sure that pte is marked valid and referenced. Also mark it
 	// dirty if the access type indicates that the page will be written to.
     // Note: Storing 'S' we have to write
     if (type == 'M' || type == 'S') {
-        pte->frame |= PG_DIRTY;
+        pte->pte |= PG_DIRTY;
+
+        // The copy on swap is now stale, so give its slot back. The page
+        // gets a new slot if it is evicted again.
+        if (pte_swap_slot(pte) != INVALID_SWAP) {
+            swap_free(s, pte_swap_off(s, pte));
+            pte_set_swap_slot(pte, INVALID_SWAP);
+        }
     }
-    pte->frame |= PG_VALID;
-    pte->frame |= PG_REF;
-    pte->frame &= ~PG_ONSWAP;   // Would make no sense to be on swap
+    pte->pte |= PG_VALID;
+    pte->pte |= PG_REF;
+    pte->pte &= ~PG_ONSWAP;   // Would make no sense to be on swap
+
+	// Remember the translation, now that the page is resident
+	if (walked && tlb != NULL) {
+		tlb_insert(tlb, vpn, pte);
+	}
 
 	// Call replacement algorithm's ref_fcn for this page
-	ref_fcn(pte);
-    ref_count++;
+	s->alg->ref(s, pte, vaddr);
+    s->ref_count++;
+    proc->ref_count++;
 
 	// Return pointer into (simulated) physical memory at start of frame
-	return &physmem[(pte->frame >> PAGE_SHIFT) * SIMPAGESIZE];
+	return &s->physmem[(size_t)pte_frame(pte) * s->pagesize];
 }
 
-void print_pagetbl(pgtbl_entry_t *pgtbl) {
+void print_pagetbl(pgtbl_entry_t *pgtbl, int nentries, unsigned pagesize) {
 	int i;
 	int first_invalid, last_invalid;
 	first_invalid = last_invalid = -1;
 
-	for (i=0; i < PTRS_PER_PGTBL; i++) {
-		if (!(pgtbl[i].frame & PG_VALID) &&
-		    !(pgtbl[i].frame & PG_ONSWAP)) {
+	for (i=0; i < nentries; i++) {
+		if (!(pgtbl[i].pte & PG_VALID) &&
+		    !(pgtbl[i].pte & PG_ONSWAP)) {
 			if (first_invalid == -1) {
 				first_invalid = i;
 			}
@@ -252,16 +461,16 @@ void print_pagetbl(pgtbl_entry_t *pgtbl) {
 				first_invalid = last_invalid = -1;
 			}
 			printf("\t[%d]: ",i);
-			if (pgtbl[i].frame & PG_VALID) {
+			if (pgtbl[i].pte & PG_VALID) {
 				printf("VALID, ");
-				if (pgtbl[i].frame & PG_DIRTY) {
+				if (pgtbl[i].pte & PG_DIRTY) {
 					printf("DIRTY, ");
 				}
-				printf("in frame %d\n",pgtbl[i].frame >> PAGE_SHIFT);
+				printf("in frame %d\n", pte_frame(&pgtbl[i]));
 			} else {
-				assert(pgtbl[i].frame & PG_ONSWAP);
+				assert(pgtbl[i].pte & PG_ONSWAP);
 				printf("ONSWAP, at offset %lu\n",
-				       (unsigned long)pgtbl[i].swap_off);
+				       (unsigned long)pte_swap_slot(&pgtbl[i]) * pagesize);
 			}
 		}
 	}
@@ -271,14 +480,34 @@ void print_pagetbl(pgtbl_entry_t *pgtbl) {
 	}
 }
 
-void print_pagedirectory() {
+// Prints every leaf table under a directory table at level, below the top.
+// path holds the indices that lead to it, like "[3][511]".
+static void print_subdirectory(struct sim *s, pgdir_entry_t *table, int level,
+		char *path, size_t pathlen) {
+	unsigned i;
+
+	for (i = 0; i < s->pt_entries[level]; i++) {
+		if (table[i].pde & PG_VALID) {
+			void *next = (void *)(table[i].pde & PAGE_MASK);
+			int len = snprintf(path + pathlen, 64, "[%u]", i);
+			if (level + 1 == s->pt_levels - 1) {
+				printf("%s: %p\n", path, next);
+				print_pagetbl(next, s->pt_entries[level + 1], s->pagesize);
+			} else {
+				print_subdirectory(s, next, level + 1, path, pathlen + len);
+			}
+		}
+	}
+	path[pathlen] = '\0';
+}
+
+static void print_directory(struct sim *s, pgdir_entry_t *pgdir) {
 	int i; // index into pgdir
 	int first_invalid,last_invalid;
 	first_invalid = last_invalid = -1;
+	char path[PT_MAX_LEVELS * 64];
 
-	pgtbl_entry_t *pgtbl;
-
-	for (i=0; i < PTRS_PER_PGDIR; i++) {
+	for (i=0; i < s->pt_entries[0]; i++) {
 		if (!(pgdir[i].pde & PG_VALID)) {
 			if (first_invalid == -1) {
 				first_invalid = i;
@@ -290,9 +519,53 @@ void print_pagedirectory() {
 				       first_invalid, last_invalid);
 				first_invalid = last_invalid = -1;
 			}
-			pgtbl = (pgtbl_entry_t *)(pgdir[i].pde & PAGE_MASK);
-			printf("[%d]: %p\n",i, pgtbl);
-			print_pagetbl(pgtbl);
+			void *next = (void *)(pgdir[i].pde & PAGE_MASK);
+			if (s->pt_levels == 2) {
+				printf("[%d]: %p\n",i, next);
+				print_pagetbl(next, s->pt_entries[1], s->pagesize);
+			} else {
+				int len = snprintf(path, sizeof(path), "[%d]", i);
+				print_subdirectory(s, next, 1, path, len);
+			}
 		}
 	}
 }
+
+void print_pagedirectory(struct sim *s) {
+	unsigned asid;
+
+	for (asid = 0; asid < s->nprocs; asid++) {
+		if (s->procs[asid].pgdir == NULL) {
+			continue;
+		}
+		if (s->nprocs > 1) {
+			printf("Process with ASID %u:\n", asid);
+		}
+		print_directory(s, s->procs[asid].pgdir);
+	}
+}
+
+// Returns the bytes of all the tables allocated so far
+size_t pagetable_bytes(struct sim *s) {
+	size_t total = 0;
+	int l;
+
+	for (l = 0; l < s->pt_levels; l++) {
+		total += s->pt_tables[l] * pt_table_bytes(s, l);
+	}
+	return total;
+}
+
+/* Prints how many tables each level of the page table has allocated and
+ * how much memory they take.
+ */
+void print_pagetable_stats(struct sim *s) {
+	int l;
+
+	for (l = 0; l < s->pt_levels; l++) {
+		size_t bytes = s->pt_tables[l] * pt_table_bytes(s, l);
+		printf("Page table level %d: %lu tables of %u entries, %.1f KiB\n",
+				l, s->pt_tables[l], s->pt_entries[l], bytes / 1024.0);
+	}
+	printf("Page table memory: %.1f KiB\n", pagetable_bytes(s) / 1024.0);
+}
@@ -15,6 +15,7 @@
 #define PG_REF          (0x4) // Reference bit, set if page has been referenced
 #define PG_ONSWAP       (0x8) // Set if page has been evicted to swap
 #define INVALID_SWAP    -1
+#define CACHE_LINE      64   // Bytes in a cache line
 
 #ifdef TRACE_64
 // User-level virtual addresses on 64-bit Linux system are 36 bits in our traces
@@ -40,9 +41,28 @@
 #define PGDIR_INDEX(x)   ((x) >> PGDIR_SHIFT)
 #define PGTBL_INDEX(x)   (((x) >> PAGE_SHIFT) & PGTBL_MASK)
 
+// The layout above is the default two-level page table. With three or more
+// levels, the page table is a radix tree like x86-64's: every table has
+// 512 entries, each level translates 9 bits, and 4 levels cover 48-bit
+// addresses. Optionally the leaves are one level up and map 2 MiB pages.
+#define PT_MAX_LEVELS     5
+#define PT_RADIX_BITS     9
+#define HUGE_PAGE_SHIFT  21
+
+// The addresses the simulator sees may come from several processes. Bits
+// 48-55 hold the ASID (address space ID) of the process and the lower 48
+// bits are the address in that process, so each process has up to 256 TiB
+// of address space and its own page directory.
+#define ASID_SHIFT       48
+#define MAX_ASIDS        256
+#define VADDR_ASID(v)    ((unsigned)((v) >> ASID_SHIFT) & (MAX_ASIDS - 1))
+#define VADDR_ADDR(v)    ((v) & ((1UL << ASID_SHIFT) - 1))
+
 
 typedef unsigned long addr_t;
 
+struct sim;
+
 // These defines allow us to take advantage of the compiler's typechecking
 
 // Page directory entry (top-level)
@@ -50,54 +70,123 @@ typedef struct {
 	uintptr_t pde;
 } pgdir_entry_t;
 
-// Page table entry (2nd-level).
+// Page table entry (leaf level), packed into one 64-bit word:
+//   bits  0-3   status bits (PG_VALID, PG_DIRTY, PG_REF, PG_ONSWAP)
+//   bits  4-31  physical frame holding vpage, if valid bit == 1
+//   bits 32-63  swap slot of vpage plus one, or 0 if it has none
+// Use the pte_* functions below rather than the fields directly.
 typedef struct {
-	unsigned int frame; // if valid bit == 1, physical frame holding vpage
-	off_t swap_off;       // offset in swap file of vpage, if any
+	uint64_t pte;
 } pgtbl_entry_t;
 
-extern void init_pagetable();
-extern char *find_physpage(addr_t vaddr, char type);
-
-extern void print_pagedirectory(void);
-
-struct frame {
-	char in_use;       // True if frame is allocated, False if frame is free
-	pgtbl_entry_t *pte;// Pointer back to pagetable entry (pte) for page
-	                   // stored in this frame
-    // int timestamp;      // Used for simple LRU implementation
+#define PTE_FLAGS_MASK    0xfUL
+#define PTE_FRAME_SHIFT   4
+#define PTE_FRAME_MASK    0xfffffff0UL
+#define PTE_SWAP_SHIFT    32
+#define PTE_MAX_FRAMES    (1U << 28)
+#define PTE_MAX_SWAP      0xfffffffeUL   // Highest swap slot, so -s is at most
+                                         // PTE_MAX_SWAP + 1
+
+// Returns the frame number of a valid entry
+static inline unsigned pte_frame(const pgtbl_entry_t *p) {
+	return (unsigned)((p->pte & PTE_FRAME_MASK) >> PTE_FRAME_SHIFT);
+}
+
+// Points the entry at frame, clearing its status bits but keeping its
+// swap slot
+static inline void pte_set_frame(pgtbl_entry_t *p, unsigned frame) {
+	p->pte = (p->pte & ~(PTE_FRAME_MASK | PTE_FLAGS_MASK))
+			| ((uint64_t)frame << PTE_FRAME_SHIFT);
+}
+
+// Returns the entry's swap slot, or INVALID_SWAP if it has none
+static inline off_t pte_swap_slot(const pgtbl_entry_t *p) {
+	return (off_t)(p->pte >> PTE_SWAP_SHIFT) - 1;
+}
+
+// Sets the entry's swap slot, or clears it if slot is INVALID_SWAP
+static inline void pte_set_swap_slot(pgtbl_entry_t *p, off_t slot) {
+	p->pte = (p->pte & ((1UL << PTE_SWAP_SHIFT) - 1))
+			| ((uint64_t)(slot + 1) << PTE_SWAP_SHIFT);
+}
+
+extern void init_pagetable(struct sim *s);
+extern void free_pagetable(struct sim *s);
+extern char *find_physpage(struct sim *s, addr_t vaddr, char type);
+
+extern void print_pagedirectory(struct sim *s);
+extern void print_pagetable_stats(struct sim *s);
+extern size_t pagetable_bytes(struct sim *s);
+
+#define FRAME_USED    0x1   // Frame has held a page, so its memory is no
+                            // longer known to be zero
+
+/* The coremap (s->coremap) holds information about physical memory.
+ * The index into each of its arrays is the physical page frame number
+ * stored in the page table entry (pgtbl_entry_t).
+ *
+ * It is a struct of arrays rather than an array of structs, so that the
+ * eviction scans, which only follow pte[], read 8 bytes per frame instead
+ * of a whole record. Each array starts on a cache line.
+ */
+struct coremap {
+	pgtbl_entry_t **pte; // Pointer back to pagetable entry (pte) for page
+	                     // stored in each frame
+	addr_t *vpn;         // Virtual page number of that page
+	unsigned char *asid; // ASID of the process the page belongs to
+	unsigned char *flags;// FRAME_USED
 };
 
-/* The coremap holds information about physical memory.
- * The index into coremap is the physical page frame number stored
- * in the page table entry (pgtbl_entry_t).
- */
-extern struct frame *coremap;
+extern void init_coremap(struct sim *s);
+extern void free_coremap(struct sim *s);
+extern size_t coremap_bytes(struct sim *s);
 
 
 // Swap functions for use in other files
-extern int swap_init(unsigned swapsize);
-extern void swap_destroy(void);
-extern int swap_pagein(unsigned frame, int swap_offset);
-extern int swap_pageout(unsigned frame, int swap_offset);
-
-extern void rand_init();
-extern void lru_init();
-extern void clock_init();
-extern void fifo_init();
-extern void opt_init();
+extern int swap_init(struct sim *s, unsigned swapsize);
+extern void swap_destroy(struct sim *s);
+extern int swap_pagein(struct sim *s, unsigned frame, off_t swap_offset);
+extern off_t swap_pageout(struct sim *s, unsigned frame, off_t swap_offset);
+extern void swap_free(struct sim *s, off_t swap_offset);
+extern int swap_set_backend(const char *name);
+extern void swap_set_writeback(unsigned batch_size);
+extern double swap_io_time(struct sim *s);
+extern unsigned long swap_io_bytes(struct sim *s);
+extern void swap_print_stats(struct sim *s);
+
+extern void rand_init(struct sim *s);
+extern void lru_init(struct sim *s);
+extern void clock_init(struct sim *s);
+extern void fifo_init(struct sim *s);
+extern void opt_init(struct sim *s);
+extern void gclock_init(struct sim *s);
+extern void clockpro_init(struct sim *s);
+extern void arc_init(struct sim *s);
+extern void twoq_init(struct sim *s);
 
 // These may not need to do anything for some algorithms
-extern void rand_ref(pgtbl_entry_t *);
-extern void lru_ref(pgtbl_entry_t *);
-extern void clock_ref(pgtbl_entry_t *);
-extern void fifo_ref(pgtbl_entry_t *);
-extern void opt_ref(pgtbl_entry_t *);
-
-extern int rand_evict();
-extern int lru_evict();
-extern int clock_evict();
-extern int fifo_evict();
-extern int opt_evict();
+extern void rand_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void lru_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void clock_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void fifo_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void opt_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void gclock_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void clockpro_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void arc_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+extern void twoq_ref(struct sim *s, pgtbl_entry_t *, addr_t vaddr);
+
+extern int rand_evict(struct sim *s);
+extern int lru_evict(struct sim *s);
+extern int clock_evict(struct sim *s);
+extern int fifo_evict(struct sim *s);
+extern int opt_evict(struct sim *s);
+extern int gclock_evict(struct sim *s);
+extern int clockpro_evict(struct sim *s);
+extern int arc_evict(struct sim *s);
+extern int twoq_evict(struct sim *s);
+
+extern void clockpro_destroy(struct sim *s);
+extern void arc_destroy(struct sim *s);
+extern void twoq_destroy(struct sim *s);
 
 #endif /* PAGETABLE_H */
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+#include "trace.h"
+
+/* Microbenchmark for the replacement algorithms' hot path.
+ *
+ * Drives an algorithm's ref and evict functions with a minimal model of
+ * residency (a page table entry per page and the coremap), without any
+ * physical memory, page table walks or swap I/O, and reports references per
+ * second. The reference stream is either synthetic or the page numbers of
+ * a trace file.
+ *
+ * With -P the references instead take the full path through
+ * find_physpage(): page table walks, frame allocation and swap to RAM. It
+ * also reports the memory used by the page tables and the coremap, to
+ * measure changes to their layout.
+ *
+ * USAGE: polbench -a algorithm[,algorithm...|all] -m memorysize [-P]
+ *                 [-f tracefile | -w uniform|zipf|loop -p pages -n refs]
+ */
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+// xorshift64*, so that workloads are the same on every run
+static uint64_t rng_next(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+/* Generates n references over pages 0..npages-1.
+ * uniform: every page equally likely.
+ * zipf: page i has probability proportional to 1/(i+1).
+ * loop: pages 0..npages-1 in order, over and over.
+ */
+static trace_rec_t *make_workload(const char *kind, size_t n, unsigned npages) {
+	trace_rec_t *recs = malloc(n * sizeof(trace_rec_t));
+	double *cdf = NULL;
+	size_t i;
+
+	if (recs == NULL) {
+		perror("polbench: malloc");
+		exit(1);
+	}
+	if (strcmp(kind, "zipf") == 0) {
+		double sum = 0;
+		cdf = malloc(npages * sizeof(double));
+		for (i = 0; i < npages; i++) {
+			sum += 1.0 / (i + 1);
+			cdf[i] = sum;
+		}
+		for (i = 0; i < npages; i++) {
+			cdf[i] /= sum;
+		}
+	} else if (strcmp(kind, "uniform") != 0 && strcmp(kind, "loop") != 0) {
+		fprintf(stderr, "polbench: unknown workload %s\n", kind);
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++) {
+		uint64_t page;
+		if (cdf != NULL) {
+			double u = (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+			unsigned lo = 0, hi = npages - 1;
+			while (lo < hi) {
+				unsigned mid = (lo + hi) / 2;
+				if (cdf[mid] < u) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			page = lo;
+		} else if (kind[0] == 'l') {
+			page = i % npages;
+		} else {
+			page = rng_next() % npages;
+		}
+		recs[i] = TREC_MAKE((rng_next() & 3) ? 'L' : 'S', page << PAGE_SHIFT);
+	}
+	free(cdf);
+	return recs;
+}
+
+/* Reads a trace and renumbers its pages densely from 0, so that they can
+ * index an array of page table entries.
+ */
+static trace_rec_t *load_workload(const char *path, size_t *n,
+		unsigned *npages) {
+	struct trace_reader tr;
+	struct pagemap ids;
+	trace_rec_t *recs;
+	size_t i;
+
+	if (trace_open(&tr, path) != 0 || trace_load(&tr) != 0) {
+		exit(1);
+	}
+	recs = malloc(tr.nrecs * sizeof(trace_rec_t));
+	if (recs == NULL) {
+		perror("polbench: malloc");
+		exit(1);
+	}
+	pagemap_init(&ids, 1024);
+	for (i = 0; i < tr.nrecs; i++) {
+		int found;
+		uint64_t *id = pagemap_insert(&ids,
+				TREC_VADDR(tr.recs[i]) >> PAGE_SHIFT, &found);
+		if (!found) {
+			*id = ids.count - 1;
+		}
+		recs[i] = TREC_MAKE(TREC_TYPE(tr.recs[i]), *id << PAGE_SHIFT);
+	}
+	*n = tr.nrecs;
+	*npages = ids.count;
+	pagemap_destroy(&ids);
+	trace_close(&tr);
+	return recs;
+}
+
+/* Runs one algorithm over the workload and prints its throughput.
+ */
+static void bench(struct functions *alg, unsigned memsize,
+		const trace_rec_t *recs, size_t n, unsigned npages) {
+	pgtbl_entry_t *ptes = calloc(npages, sizeof(pgtbl_entry_t));
+	struct sim *s = sim_create(memsize, 1, alg, recs, n);
+	unsigned nfree = 0;
+	unsigned long misses = 0;
+	double start, elapsed;
+	size_t i;
+
+	if (ptes == NULL) {
+		perror("polbench: calloc");
+		exit(1);
+	}
+
+	start = trace_now();
+	for (i = 0; i < n; i++) {
+		pgtbl_entry_t *pte = &ptes[TREC_VADDR(recs[i]) >> PAGE_SHIFT];
+
+		if (!(pte->pte & PG_VALID)) {
+			unsigned frame;
+			if (nfree < memsize) {
+				frame = nfree++;
+			} else {
+				frame = alg->evict(s);
+				s->coremap.pte[frame]->pte = 0;
+			}
+			s->coremap.pte[frame] = pte;
+			pte_set_frame(pte, frame);
+			pte->pte |= PG_VALID;
+			misses++;
+		}
+		pte->pte |= PG_REF;
+		alg->ref(s, pte, TREC_VADDR(recs[i]));
+		s->trace_pos++;
+	}
+	elapsed = trace_now() - start;
+
+	printf("%-8s %10u %12lu %12lu %10.4f %14.0f %8.2f\n", alg->name, memsize,
+			(unsigned long)n, misses, elapsed, n / elapsed, elapsed * 1e9 / n);
+
+	sim_destroy(s);
+	free(ptes);
+}
+
+/* Runs one algorithm over the workload through find_physpage() and prints
+ * its throughput and the memory used by its page tables and coremap.
+ */
+static void bench_full(struct functions *alg, unsigned memsize,
+		const trace_rec_t *recs, size_t n, unsigned npages) {
+	struct sim *s = sim_create(memsize, npages, alg, recs, n);
+	double start, elapsed;
+
+	start = trace_now();
+	replay_recs(s, recs, n);
+	elapsed = trace_now() - start;
+
+	printf("%-8s %10u %12lu %12lu %10.4f %14.0f %8.2f %10.1f %10.1f\n",
+			alg->name, memsize, (unsigned long)n, s->miss_count, elapsed,
+			n / elapsed, elapsed * 1e9 / n, pagetable_bytes(s) / 1024.0,
+			coremap_bytes(s) / 1024.0);
+
+	sim_destroy(s);
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	int i, nalgs;
+	int full = 0;
+	unsigned memsize = 0;
+	unsigned npages = 100000;
+	size_t n = 10000000;
+	char *tracefile = NULL;
+	char *workload = "zipf";
+	char *alg_arg = NULL;
+	struct functions **selected;
+	trace_rec_t *recs;
+	char *usage = "USAGE: polbench -a algorithm[,algorithm...|all] -m memorysize [-P] [-f tracefile | -w uniform|zipf|loop -p pages -n refs]\n";
+
+	while ((opt = getopt(argc, argv, "a:m:f:w:p:n:P")) != -1) {
+		switch (opt) {
+		case 'a':
+			alg_arg = optarg;
+			break;
+		case 'm':
+			memsize = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			tracefile = optarg;
+			break;
+		case 'w':
+			workload = optarg;
+			break;
+		case 'p':
+			npages = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 'P':
+			full = 1;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (alg_arg == NULL || memsize == 0 || npages == 0) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+
+	if (tracefile != NULL) {
+		recs = load_workload(tracefile, &n, &npages);
+	} else {
+		recs = make_workload(workload, n, npages);
+	}
+
+	selected = malloc(num_algs * sizeof(struct functions *));
+	nalgs = parse_algs(alg_arg, selected);
+
+	if (full) {
+		// Keep swap in memory, so that disk I/O does not drown the walk
+		swap_set_backend("ram");
+		printf("%-8s %10s %12s %12s %10s %14s %8s %10s %10s\n", "alg",
+				"memsize", "refs", "misses", "seconds", "refs/sec", "ns/ref",
+				"pt KiB", "cmap KiB");
+	} else {
+		printf("%-8s %10s %12s %12s %10s %14s %8s\n", "alg", "memsize",
+				"refs", "misses", "seconds", "refs/sec", "ns/ref");
+	}
+	for (i = 0; i < nalgs; i++) {
+		if (full) {
+			bench_full(selected[i], memsize, recs, n, npages);
+		} else {
+			bench(selected[i], memsize, recs, n, npages);
+		}
+	}
+
+	free(selected);
+	free(recs);
+	return 0;
+}
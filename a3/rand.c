@@ -7,17 +7,18 @@
 #include "pagetable.h"
 
 
-
-extern struct frame *coremap;
-
 /* Page to evict is chosen using the rand algorithm.
  * Returns the page frame number (which is also the index in the coremap)
  * for the page that is to be evicted.
  */
-int rand_evict() {
+int rand_evict(struct sim *s) {
 	// choose index in coremap to evict a page from
-	int idx = (int)(random() % memsize);
-	
+	int idx;
+	do {
+		idx = (int)(sim_random(s) % s->memsize);
+		s->evict_scan++;
+	} while (!frame_evictable(s, idx));
+
 	return idx;
 }
 
@@ -25,10 +26,10 @@ int rand_evict() {
  * needed by the rand algorithm.
  * Input: The page table entry for the page that is being accessed.
  */
-void rand_ref(pgtbl_entry_t *p) {
+void rand_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
 
 	return;
 }
 
-void rand_init() {
+void rand_init(struct sim *s) {
 }
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagesample.h"
+#include "trace.h"
+
+/* Sampled LRU miss-ratio curve in a fixed amount of memory (SHARDS).
+ *
+ * lru-mrc keeps the last reference time of every page in the trace. Here
+ * only the pages of a spatially hashed sample are kept (pagesample.h), and
+ * each of their references stands for 1/R references at R times its stack
+ * distance, R being the sampling rate at the time. The rate drops as the
+ * sample fills the budget. The histogram is then made to add up to the
+ * trace's references (pagesample_adjust()), since a few very hot pages
+ * in or out of the sample can throw its total far off.
+ *
+ * Estimated distances go into a histogram of SHARDS_BINS bins of equal
+ * width, which doubles when a distance falls past the last bin, so the
+ * histogram is bounded too. Misses at sizes inside a bin are interpolated.
+ */
+#define SHARDS_BINS 4096
+
+typedef struct __shards_t {
+    struct pagesample ps;
+    double hist[SHARDS_BINS];   // hist[b] = references with distances in
+                                // (b * width, (b + 1) * width]
+    double width;
+    double cold;                // First references to a page
+    unsigned long refs;
+} shards_t;
+
+
+/* Records a reference to virtual page vpn.
+ */
+static void shards_ref(shards_t *sh, uint64_t vpn) {
+    double d;
+    size_t b, i;
+
+    sh->refs++;
+    if (!pagesample_ref(&sh->ps, vpn, &d)) {
+        return;
+    }
+    if (d == 0) {
+        sh->cold += 1 / pagesample_rate(&sh->ps);
+        return;
+    }
+    while ((b = (size_t)((d - 1) / sh->width)) >= SHARDS_BINS) {
+        for (i = 0; i < SHARDS_BINS / 2; i++) {
+            sh->hist[i] = sh->hist[2 * i] + sh->hist[2 * i + 1];
+        }
+        memset(sh->hist + SHARDS_BINS / 2, 0, SHARDS_BINS / 2 * sizeof(double));
+        sh->width *= 2;
+    }
+    sh->hist[b] += 1 / pagesample_rate(&sh->ps);
+}
+
+/* Computes the LRU miss-ratio curve in one pass over a sample of the trace
+ * that fits in about budget bytes, and prints it as CSV, like lru-mrc. If
+ * step is 0, every memory size from 1 frame up to the estimated footprint
+ * is printed; otherwise sizes first..last in steps of step.
+ *
+ * If compare is true, the trace must be loaded, and the curve is checked
+ * against lru at each size, replayed on nthreads threads, with the error
+ * in percentage points of hit rate.
+ */
+void run_lru_shards(struct trace_reader *tr, unsigned first, unsigned last,
+        unsigned step, size_t budget, int compare, unsigned swapsize,
+        int nthreads) {
+    shards_t *sh;
+    const trace_rec_t *recs;
+    size_t i, n, k;
+    int phase = WINDOW_WARMUP;
+    unsigned long *exact = NULL;
+    double hits, err, err_sum = 0, err_max = 0;
+    unsigned m, b, nsizes = 0;
+    int shift = sim_page_shift();
+
+    if (budget <= sizeof(shards_t)) {
+        fprintf(stderr, "Error: lru-shards needs a budget of more than %zu bytes\n",
+                sizeof(shards_t));
+        exit(1);
+    }
+    sh = calloc(1, sizeof(shards_t));
+    if (sh == NULL) {
+        perror("lru-shards: calloc");
+        exit(1);
+    }
+    sh->width = 1;
+    pagesample_init(&sh->ps, budget - sizeof(shards_t));
+
+    while (phase != WINDOW_DONE && (n = trace_next(tr, &recs)) > 0) {
+        for (; n > 0; recs += k, n -= k) {
+            int prev = phase;
+            k = trace_window(tr, recs, n, &phase);
+            if (phase == WINDOW_DONE) {
+                break;
+            }
+            if (phase != prev) {
+                // Warm-up references leave their pages in the sample, but
+                // their distances are not counted
+                memset(sh->hist, 0, sizeof(sh->hist));
+                sh->cold = 0;
+                sh->refs = 0;
+            }
+            for (i = 0; i < k; i++) {
+                shards_ref(sh, TREC_VADDR(recs[i]) >> shift);
+            }
+        }
+    }
+
+    pagesample_adjust(sh->hist, SHARDS_BINS, &sh->cold, sh->refs);
+
+    if (step == 0) {
+        first = 1;
+        last = (unsigned)(sh->cold + 0.5);
+        step = 1;
+    }
+    if (compare) {
+        exact = malloc(((last - first) / step + 1) * sizeof(unsigned long));
+        if (exact == NULL) {
+            perror("lru-shards: malloc");
+            exit(1);
+        }
+        sweep_misses(tr->recs, tr->nrecs, tr->warmup, sh->refs, swapsize,
+                find_alg("lru"), first, last, step, nthreads, exact);
+        printf("memsize,references,hits,misses,hit_rate,lru_hit_rate,error\n");
+    } else {
+        printf("memsize,references,hits,misses,hit_rate\n");
+    }
+
+    // hits(m) = references whose distance is at most m, the bin holding m
+    // counting in proportion
+    hits = 0;
+    b = 0;
+    for (m = first; m >= first && m <= last; m += step) {
+        double part, rate;
+        while (b < SHARDS_BINS && (b + 1) * sh->width <= m) {
+            hits += sh->hist[b++];
+        }
+        part = b < SHARDS_BINS ? sh->hist[b] * (m - b * sh->width) /
+                sh->width : 0;
+        if (hits + part > sh->refs - sh->cold) {
+            part = sh->refs - sh->cold - hits;
+        }
+        rate = sh->refs ? (hits + part) / sh->refs * 100 : 0;
+        printf("%u,%lu,%.0f,%.0f,%.4f", m, sh->refs, hits + part,
+                sh->refs - hits - part, rate);
+        if (compare) {
+            double lru_rate = sh->refs ? (double)(sh->refs - exact[nsizes]) /
+                    sh->refs * 100 : 0;
+            err = rate > lru_rate ? rate - lru_rate : lru_rate - rate;
+            err_sum += err;
+            if (err > err_max) {
+                err_max = err;
+            }
+            printf(",%.4f,%.4f", lru_rate, err);
+        }
+        printf("\n");
+        nsizes++;
+    }
+
+    fprintf(stderr, "Sampled %zu pages at rate %.6f, estimated footprint %.0f pages\n",
+            sh->ps.sd.last.count, pagesample_rate(&sh->ps), sh->cold);
+    if (compare && nsizes > 0) {
+        fprintf(stderr, "Error vs lru: mean %.4f, max %.4f percentage points of hit rate over %u sizes\n",
+                err_sum / nsizes, err_max, nsizes);
+    }
+
+    pagesample_destroy(&sh->ps);
+    free(sh);
+    free(exact);
+}
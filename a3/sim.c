@@ -1,165 +1,569 @@
 #include <stdio.h>
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include "sim.h"
 #include "pagetable.h"
+#include "trace.h"
+#include "tlb.h"
+#include "inst.h"
 
-// Define global variables declared in sim.h
-unsigned memsize = 0;
-int debug = 0;
-char *physmem = NULL;
-struct frame *coremap = NULL;
 char *tracefile = NULL;
 
-/* The algs array gives us a mapping between the name of an eviction
- * algorithm as given in a command line argument, and the function to
- * call to select the victim page.
- */
-struct functions algs[] = {
-	{"rand", rand_init, rand_ref, rand_evict}, 
-	{"lru", lru_init, lru_ref, lru_evict},
-	{"fifo", fifo_init, fifo_ref, fifo_evict},
-	{"clock",clock_init, clock_ref, clock_evict},
-};
-int num_algs = 5;
-
-void (*init_fcn)() = NULL;
-void (*ref_fcn)(pgtbl_entry_t *) = NULL;
-int (*evict_fcn)() = NULL;
-
-
-/* An actual memory access based on the vaddr from the trace file.
- *
- * The find_physpage() function is called to translate the virtual address
- * to a (simulated) physical address -- that is, a pointer to the right
- * location in physmem array. The find_physpage() function is responsible for
- * everything to do with memory management - including translation using the
- * pagetable, allocating a frame of (simulated) physical memory (if needed),
- * evicting an existing page from the frame (if needed) and reading the page
- * in from swap (if needed).
- *
- * We then check that the memory has the expected content (just a copy of the
- * virtual address) and, in case of a write reference, increment the version
- * counter. 
+
+void print_tlb_stats(const char *name, struct tlb *tlb) {
+	unsigned long lookups = tlb->hits + tlb->misses;
+	printf("%s hit rate: %.4f (%lu lookups, %lu shootdowns, %u sets x %u ways)\n",
+			name, lookups ? (double)tlb->hits/lookups * 100 : 0.0, lookups,
+			tlb->shootdowns, tlb->nsets, tlb->ways);
+}
+
+void print_stats(struct sim *s) {
+	printf("\n");
+	printf("Hit count: %lu\n", s->hit_count);
+	printf("Miss count: %lu\n", s->miss_count);
+	printf("Clean evictions: %lu\n", s->evict_clean_count);
+	printf("Dirty evictions: %lu\n", s->evict_dirty_count);
+	printf("Total references : %lu\n", s->ref_count);
+	// A marker-bounded window can be empty
+	printf("Hit rate: %.4f\n",
+			s->ref_count ? (double)s->hit_count/s->ref_count * 100 : 0.0);
+	printf("Miss rate: %.4f\n",
+			s->ref_count ? (double)s->miss_count/s->ref_count * 100 : 0.0);
+	if (s->itlb != NULL) {
+		print_tlb_stats("ITLB", s->itlb);
+		print_tlb_stats("DTLB", s->dtlb);
+	}
+}
+
+/* Prints one row per process of a multi-process trace, labelled with the
+ * pids the trace recorded, if any.
  */
-void access_mem(char type, addr_t vaddr) {
-	char *memptr = find_physpage(vaddr, type);
-	int *versionptr = (int *)memptr;
-	addr_t *checkaddr = (addr_t *)(memptr + sizeof(int));
+void print_process_stats(struct sim *s, struct trace_reader *tr) {
+	unsigned asid;
 
-	if (*checkaddr != vaddr) {
-		fprintf(stderr,"Error, simulated page returned by pagetable lookup doese not have expected value.\n");
+	printf("\n%-6s %10s %12s %12s %12s %10s %10s\n", "ASID", "pid", "References",
+			"Misses", "Evicted", "Resident", "Hit rate");
+	for (asid = 0; asid < s->nprocs; asid++) {
+		struct process *proc = &s->procs[asid];
+		if (proc->ref_count == 0) {
+			continue;
+		}
+		printf("%-6u %10u %12lu %12lu %12lu %10u %10.4f\n", asid,
+				asid < tr->nasids ? tr->pids[asid] : 0, proc->ref_count,
+				proc->miss_count, proc->evict_count, proc->resident,
+				(double)proc->hit_count/proc->ref_count * 100);
 	}
-	
-	if (type == 'S' || type == 'M') {
-		// write access to page, increment version number
-		(*versionptr)++;
+}
+
+/* Prints one row per simulation, for comparing algorithms on the same trace.
+ */
+void print_comparison(struct sim **sims, int nsims) {
+	int i;
+	printf("%-10s %12s %12s %12s %12s %10s\n", "Algorithm", "Hits", "Misses",
+			"Clean evict", "Dirty evict", "Hit rate");
+	for (i = 0; i < nsims; i++) {
+		struct sim *s = sims[i];
+		printf("%-10s %12lu %12lu %12lu %12lu %10.4f\n", s->alg->name,
+				s->hit_count, s->miss_count, s->evict_clean_count,
+				s->evict_dirty_count,
+				s->ref_count ? (double)s->hit_count/s->ref_count * 100 : 0.0);
 	}
+}
 
+/* Reports how many references warmed up the simulation without being
+ * counted, or warns if the trace is missing a marker store.
+ */
+void print_window(struct trace_reader *tr) {
+	if (!tr->windowed) {
+		return;
+	}
+	if (tr->phase == WINDOW_WARMUP) {
+		fprintf(stderr, "Warning: the trace never stores to MARKER_START (%#lx), so every reference was counted\n",
+				tr->marker_start);
+		return;
+	}
+	if (tr->phase == WINDOW_MEASURE) {
+		fprintf(stderr, "Warning: the trace never stores to MARKER_END (%#lx), so it was counted to the end\n",
+				tr->marker_end);
+	}
+	fprintf(stderr, "Warm-up references: %lu (not counted)\n", tr->warmup);
 }
 
+/* Parses a memory size in frames, or a range first:last:step of them,
+ * starting from at least 1 frame. A single size leaves *last and *step
+ * alone.
+ * Returns 0 on success, or -1 after printing an error.
+ */
+int parse_memsize(const char *arg, unsigned *first, unsigned *last,
+		unsigned *step) {
+	unsigned a, b, c;
+	char junk;
+
+	if (sscanf(arg, "%u%c", &a, &junk) == 1) {
+		if (a == 0) {
+			fprintf(stderr, "Error: memory size must be at least 1 frame\n");
+			return -1;
+		}
+		*first = a;
+		return 0;
+	}
+	if (sscanf(arg, "%u:%u:%u%c", &a, &b, &c, &junk) != 3) {
+		fprintf(stderr, "Error: memory size must be a number or first:last:step\n");
+		return -1;
+	}
+	if (a == 0) {
+		fprintf(stderr, "Error: memory size range must start at 1 frame or more\n");
+		return -1;
+	}
+	if (c == 0) {
+		fprintf(stderr, "Error: memory size step must be positive\n");
+		return -1;
+	}
+	if (b < a) {
+		fprintf(stderr, "Error: memory size range %u:%u ends before it starts\n",
+				a, b);
+		return -1;
+	}
+	*first = a;
+	*last = b;
+	*step = c;
+	return 0;
+}
 
-void replay_trace(FILE *infp) {
-	char buf[MAXLINE];
-	addr_t vaddr = 0;
-	char type;
+/* Parses a TLB size, entries or entries:ways. Without ways, *ways is kept
+ * unless the TLB is smaller, in which case it is fully associative.
+ * Returns 0 on success, or -1 after printing an error.
+ */
+int parse_tlb(const char *arg, unsigned *entries, unsigned *ways) {
+	unsigned e, w = *ways;
+	char junk;
+	int n = sscanf(arg, "%u:%u%c", &e, &w, &junk);
 
-	while(fgets(buf, MAXLINE, infp) != NULL) {
-		if(buf[0] != '=') {
-			sscanf(buf, "%c %lx", &type, &vaddr);
-			if(debug)  {
-				printf("%c %lx\n", type, vaddr);
-			}
-			access_mem(type, vaddr);
-		} else {
-			continue;
+	if (n == 1 && sscanf(arg, "%u%c", &e, &junk) == 1) {
+		if (w > e) {
+			w = e;
 		}
+	} else if (n != 2) {
+		fprintf(stderr, "Error: TLB size must be entries or entries:ways\n");
+		return -1;
+	}
+	if (e == 0 || w == 0 || w > e) {
+		fprintf(stderr, "Error: a TLB needs at least one entry, and from 1 to that many ways\n");
+		return -1;
+	}
+	*entries = e;
+	*ways = w;
+	return 0;
+}
+
+/* Parses a decimal number from min to max. what names it in the error.
+ * Returns 0 on success, or -1 after printing an error.
+ */
+static int parse_count(const char *arg, const char *what, unsigned long min,
+		unsigned long max, unsigned long *value) {
+	char *end;
 
+	errno = 0;
+	*value = strtoul(arg, &end, 10);
+	if (!isdigit((unsigned char)arg[0]) || *end != '\0' || errno == ERANGE ||
+			*value < min || *value > max) {
+		fprintf(stderr, "Error: %s must be a number from %lu to %lu\n", what,
+				min, max);
+		return -1;
 	}
+	return 0;
+}
+
+/* Parses a number of bytes, optionally followed by K, M or G, into *size.
+ * Returns 0 on success, or -1 if arg is not such a number.
+ */
+static int parse_suffixed(const char *arg, unsigned long long *size) {
+	char *end;
+	int shift = 0;
+
+	*size = strtoull(arg, &end, 10);
+	if (end == arg) {
+		return -1;
+	}
+	if (*end == 'K' || *end == 'k') {
+		shift = 10;
+	} else if (*end == 'M' || *end == 'm') {
+		shift = 20;
+	} else if (*end == 'G' || *end == 'g') {
+		shift = 30;
+	}
+	if (shift > 0) {
+		end++;
+	}
+	if (*end != '\0' || *size > (ULLONG_MAX >> shift)) {
+		return -1;
+	}
+	*size <<= shift;
+	return 0;
+}
+
+/* Parses a size in bytes, optionally followed by K, M or G.
+ * Returns 0 on success, or -1 after printing an error.
+ */
+int parse_bytes(const char *arg, size_t *bytes) {
+	unsigned long long size;
+
+	if (parse_suffixed(arg, &size) != 0 || size == 0 || size > SIZE_MAX) {
+		fprintf(stderr, "Error: bad size %s\n", arg);
+		return -1;
+	}
+	*bytes = (size_t)size;
+	return 0;
+}
+
+/* Parses a frame size in bytes, optionally followed by K or M. It must be
+ * a power of two between MIN_SIMPAGESIZE and MAX_SIMPAGESIZE.
+ * Returns 0 on success, or -1 after printing an error.
+ */
+int parse_pagesize(const char *arg, unsigned *pagesize) {
+	unsigned long long size;
+
+	if (parse_suffixed(arg, &size) != 0 || size < MIN_SIMPAGESIZE ||
+			size > MAX_SIMPAGESIZE || (size & (size - 1)) != 0) {
+		fprintf(stderr, "Error: page size must be a power of two from %d to %d bytes\n",
+				MIN_SIMPAGESIZE, MAX_SIMPAGESIZE);
+		return -1;
+	}
+	*pagesize = (unsigned)size;
+	return 0;
+}
+
+/* Returns true if alg names one of the trace analyses, which run instead of
+ * a simulation.
+ */
+static int is_analysis(const char *alg) {
+	return strcmp(alg, "lru-mrc") == 0 || strcmp(alg, "lru-shards") == 0 ||
+			strcmp(alg, "wss") == 0;
 }
 
 
 int main(int argc, char *argv[]) {
 	int opt;
+	int i;
+	unsigned memsize = 0;
+	unsigned mem_last = 0, mem_step = 0;
 	unsigned swapsize = 4096;
-	FILE *tfp = stdin;
+	int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int timing = 0;
+	int compare = 0;
+	int pagesize_set = 0;
+	double start, replay_time, swap_time = 0, swap_bytes = 0;
+	struct trace_reader tr;
+	struct functions **selected;
+	struct sim **sims;
+	int nsims;
 	char *replacement_alg = NULL;
-	char *usage = "USAGE: sim -f tracefile -m memorysize -s swapsize -a algorithm\n";
+	char *markerfile = NULL;
+	char *instfile = NULL;
+	unsigned long count;
+	unsigned long taus[WSS_MAX_TAUS] = {1000, 10000, 100000};
+	int ntaus = 3;
+	size_t budget = 64 << 20;
+	char *tau, *save, *end;
+	char *usage = "USAGE: sim -f tracefile -m memorysize[:last:step] -s swapsize -a algorithm[,algorithm...|all|lru-mrc|lru-shards|wss] [-p pagesize] [-L levels] [-H] [-T entries[:ways]] [-l] [-b file|mmap|ram] [-W batch] [-M markerfile] [-w tau[,tau...]] [-B budget] [-e] [-i interval[:file]] [-t] [-j threads]\n";
 
-	while ((opt = getopt(argc, argv, "f:m:a:s:")) != -1) {
+	while ((opt = getopt(argc, argv, "f:m:a:s:p:L:HT:lb:W:M:w:B:ei:tj:")) != -1) {
 		switch (opt) {
 		case 'f':
 			tracefile = optarg;
 			break;
 		case 'm':
-			memsize = (unsigned)strtoul(optarg, NULL, 10);
+			// A range first:last:step sweeps memory sizes in parallel
+			if (parse_memsize(optarg, &memsize, &mem_last, &mem_step) != 0) {
+				exit(1);
+			}
 			break;
 		case 'a':
 			replacement_alg = optarg;
 			break;
 		case 's':
-			swapsize = (unsigned)strtoul(optarg, NULL, 10);
+			if (parse_count(optarg, "swap size", 1, PTE_MAX_SWAP + 1, &count) != 0) {
+				exit(1);
+			}
+			swapsize = (unsigned)count;
+			break;
+		case 'p':
+			if (parse_pagesize(optarg, &sim_pagesize) != 0) {
+				exit(1);
+			}
+			pagesize_set = 1;
+			break;
+		case 'L':
+			if (parse_count(optarg, "page table levels", 2, PT_MAX_LEVELS,
+					&count) != 0) {
+				exit(1);
+			}
+			sim_pt_levels = (int)count;
+			break;
+		case 'H':
+			// Leaf page table entries map 2 MiB pages
+			sim_huge_pages = 1;
+			break;
+		case 'T':
+			// Separate instruction and data TLBs of this size
+			if (parse_tlb(optarg, &sim_tlb_entries, &sim_tlb_ways) != 0) {
+				exit(1);
+			}
+			break;
+		case 'l':
+			// Each process replaces only its own pages
+			sim_local_replacement = 1;
+			break;
+		case 'b':
+			if (swap_set_backend(optarg) != 0) {
+				exit(1);
+			}
+			break;
+		case 'W':
+			// Dirty evictions are queued and written in batches (0 to write
+			// them synchronously)
+			if (parse_count(optarg, "writeback batch", 0, UINT_MAX, &count) != 0) {
+				exit(1);
+			}
+			swap_set_writeback((unsigned)count);
+			break;
+		case 'M':
+			// Count only the references between the program's markers
+			markerfile = optarg;
+			break;
+		case 'w':
+			// Working-set window sizes for wss, in references
+			for (ntaus = 0, tau = strtok_r(optarg, ",", &save); tau != NULL;
+					tau = strtok_r(NULL, ",", &save)) {
+				if (ntaus == WSS_MAX_TAUS) {
+					fprintf(stderr, "Error: at most %d window sizes\n",
+							WSS_MAX_TAUS);
+					exit(1);
+				}
+				// wss sizes each window's sketch from 8 * tau
+				if (parse_count(tau, "window size", 1, ULONG_MAX / 8,
+						&taus[ntaus++]) != 0) {
+					exit(1);
+				}
+			}
+			break;
+		case 'B':
+			// Memory for the sampled analyses
+			if (parse_bytes(optarg, &budget) != 0) {
+				exit(1);
+			}
+			break;
+		case 'e':
+			// Check lru-shards against lru
+			compare = 1;
+			break;
+		case 'i':
+			// Time the stages of the replay, and sample the counters every
+			// interval references (0 for no time series)
+			sim_instrument = 1;
+			errno = 0;
+			sim_inst_interval = strtoul(optarg, &end, 10);
+			if (!isdigit((unsigned char)optarg[0]) || errno == ERANGE ||
+					(*end != '\0' && (*end != ':' || end[1] == '\0'))) {
+				fprintf(stderr, "Error: -i takes an interval, optionally followed by :file\n");
+				exit(1);
+			}
+			instfile = (*end == ':') ? end + 1 : NULL;
+			break;
+		case 't':
+			timing = 1;
+			break;
+		case 'j':
+			if (parse_count(optarg, "threads", 1, INT_MAX, &count) != 0) {
+				exit(1);
+			}
+			nthreads = (int)count;
 			break;
 		default:
 			fprintf(stderr, "%s", usage);
 			exit(1);
 		}
 	}
-	if(tracefile != NULL) {
-		if((tfp = fopen(tracefile, "r")) == NULL) {
-			perror("Error opening tracefile:");
+	// Only the trace analyses do without a memory size
+	if(replacement_alg == NULL ||
+			(memsize == 0 && !is_analysis(replacement_alg))) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+	if (sim_pt_levels < 2 || sim_pt_levels > PT_MAX_LEVELS ||
+			(sim_huge_pages && sim_pt_levels < 3)) {
+		fprintf(stderr, "Error: the page table needs 2 to %d levels, and at least 3 for huge pages\n",
+				PT_MAX_LEVELS);
+		exit(1);
+	}
+
+	if (pagesize_set && is_analysis(replacement_alg)) {
+		// -p only sizes the simulated frames' contents; pages are 4 KiB,
+		// or 2 MiB with -H, in the analyses as in the simulation
+		fprintf(stderr, "Error: -p does not apply to %s; use -H for 2 MiB pages\n",
+				replacement_alg);
+		exit(1);
+	}
+	if (compare && (strcmp(replacement_alg, "lru-shards") != 0 ||
+			mem_step == 0)) {
+		fprintf(stderr, "Error: -e checks lru-shards over a range of memory sizes\n");
+		exit(1);
+	}
+	if (sim_instrument && (mem_step > 0 || is_analysis(replacement_alg))) {
+		fprintf(stderr, "Error: -i instruments a single replay, not a sweep or an analysis\n");
+		exit(1);
+	}
+	if (sim_inst_interval > 0) {
+		sim_inst_out = stderr;
+		if (instfile != NULL && (sim_inst_out = fopen(instfile, "w")) == NULL) {
+			perror("Error opening instrumentation file");
 			exit(1);
 		}
+		inst_print_header(sim_inst_out);
 	}
 
-	// Initialize main data structures for simulation.
-	// This happens before calling the replacement algorithm init function
-	// so that the init_fcn can refer to the coremap if needed.
-	coremap = calloc(memsize, sizeof(struct frame));
-	physmem = malloc(memsize * SIMPAGESIZE);
-	swap_init(swapsize);
-	init_pagetable();
-
-	// Initialize replacement algorithm functions.
-	if(replacement_alg == NULL) {
-		fprintf(stderr, "%s", usage);
+	// Text traces are parsed as they are read; binary traces are mmapped.
+	if(trace_open(&tr, tracefile) != 0) {
 		exit(1);
-	} else {
-		int i;
-		for (i = 0; i < num_algs; i++) {
-			if(strcmp(algs[i].name, replacement_alg) == 0) {
-				init_fcn = algs[i].init;
-				ref_fcn = algs[i].ref;
-				evict_fcn = algs[i].evict;
-				break;
-			}
+	}
+	if (markerfile != NULL && trace_set_markers(&tr, markerfile) != 0) {
+		exit(1);
+	}
+
+	// The trace analyses need neither a simulation nor a memory size: the
+	// LRU miss-ratio curve covers every memory size in one pass, exactly or
+	// (lru-shards) from a sample bounded by -B, as does the working-set
+	// analysis. Checking lru-shards against lru (-e) replays the loaded
+	// trace at every size in the range.
+	if (is_analysis(replacement_alg)) {
+		if (compare && trace_load(&tr) != 0) {
+			exit(1);
+		}
+		if (memsize > 0 && mem_step == 0) {
+			// A single size prints the curve at that size only
+			mem_last = memsize;
+			mem_step = 1;
 		}
-		if(evict_fcn == NULL) {
-			fprintf(stderr, "Error: invalid replacement algorithm - %s\n", 
-					replacement_alg);
+		start = trace_now();
+		if (strcmp(replacement_alg, "lru-mrc") == 0) {
+			run_lru_mrc(&tr, memsize, mem_last, mem_step);
+		} else if (strcmp(replacement_alg, "lru-shards") == 0) {
+			run_lru_shards(&tr, memsize, mem_last, mem_step, budget, compare,
+					swapsize, nthreads > 0 ? nthreads : 1);
+		} else {
+			run_wss(&tr, taus, ntaus, budget);
+		}
+		print_window(&tr);
+		if (timing) {
+			fprintf(stderr, "Decode time: %.6f s\n", tr.decode_time);
+			fprintf(stderr, "Analysis time: %.6f s\n", trace_now() - start);
+		}
+		trace_close(&tr);
+		return(0);
+	}
+
+	selected = malloc(num_algs * sizeof(struct functions *));
+	nsims = parse_algs(replacement_alg, selected);
+
+	// Sweep mode: every (memory size, algorithm) pair runs in its own
+	// simulation on a pool of threads sharing the read-only trace.
+	if (mem_step > 0) {
+		size_t warmup = 0, window;
+		int phase;
+		if (trace_load(&tr) != 0) {
 			exit(1);
 		}
+		// Every job replays the same window, so find it once
+		window = trace_window(&tr, tr.recs, tr.nrecs, &phase);
+		if (phase == WINDOW_WARMUP && tr.phase != WINDOW_WARMUP) {
+			warmup = window;
+			window = trace_window(&tr, tr.recs + warmup, tr.nrecs - warmup,
+					&phase);
+		}
+		start = trace_now();
+		run_sweep(tr.recs, tr.nrecs, warmup, window, swapsize, selected, nsims,
+				memsize, mem_last, mem_step, nthreads > 0 ? nthreads : 1);
+		print_window(&tr);
+		if (timing) {
+			fprintf(stderr, "Decode time: %.6f s\n", tr.decode_time);
+			fprintf(stderr, "Sweep time: %.6f s\n", trace_now() - start);
+		}
+		free(selected);
+		trace_close(&tr);
+		return(0);
 	}
-	// Call replacement algorithm's init_fcn before replaying trace.
-	init_fcn();
 
-	replay_trace(tfp);
-	print_pagedirectory();
+	// Offline algorithms look ahead, so the whole trace must be loaded.
+	for (i = 0; i < nsims; i++) {
+		if (selected[i]->offline && trace_load(&tr) != 0) {
+			exit(1);
+		}
+	}
 
-	// Cleanup - removes temporary swapfile.
-	swap_destroy();
+	// One independent simulation per requested replacement algorithm.
+	sims = malloc(nsims * sizeof(struct sim *));
+	for (i = 0; i < nsims; i++) {
+		sims[i] = sim_create(memsize, swapsize, selected[i], tr.recs,
+				tr.nrecs);
+	}
+
+	start = trace_now();
+	replay_trace(&tr, sims, nsims);
+	replay_time = trace_now() - start;
+	print_window(&tr);
+
+	if (nsims == 1) {
+		print_pagedirectory(sims[0]);
+		print_stats(sims[0]);
+		if (sims[0]->nprocs > 1) {
+			print_process_stats(sims[0], &tr);
+		}
+	} else {
+		print_comparison(sims, nsims);
+	}
+	if(timing) {
+		printf("Decode time: %.6f s\n", tr.decode_time);
+		printf("Replay time: %.6f s\n", replay_time);
+		for (i = 0; i < nsims; i++) {
+			swap_time += swap_io_time(sims[i]);
+			swap_bytes += swap_io_bytes(sims[i]);
+		}
+		printf("Swap I/O time: %.6f s (%.1f MiB)\n", swap_time,
+				swap_bytes / (1024.0 * 1024.0));
+		for (i = 0; i < nsims; i++) {
+			swap_print_stats(sims[i]);
+		}
+		// Every simulation maps the same pages, so their tables match
+		print_pagetable_stats(sims[0]);
+		printf("Throughput: %.0f refs/sec\n",
+				sims[0]->ref_count * nsims / replay_time);
+	}
+
+	if (sim_instrument) {
+		for (i = 0; i < nsims; i++) {
+			inst_print(sims[i], tr.decode_cycles);
+		}
+		if (sim_inst_out != NULL && sim_inst_out != stderr &&
+				fclose(sim_inst_out) != 0) {
+			perror("Error writing instrumentation file");
+			exit(1);
+		}
+	}
+
+	// Cleanup - removes temporary swapfiles.
+	for (i = 0; i < nsims; i++) {
+		sim_destroy(sims[i]);
+	}
+	free(sims);
+	free(selected);
+	trace_close(&tr);
 
-	printf("\n");
-	printf("Hit count: %d\n", hit_count);
-	printf("Miss count: %d\n", miss_count);
-	printf("Clean evictions: %d\n",evict_clean_count);
-	printf("Dirty evictions: %d\n",evict_dirty_count); 
-	printf("Total references : %d\n", ref_count);
-	printf("Hit rate: %.4f\n", (double)hit_count/ref_count * 100);
-	printf("Miss rate: %.4f\n", (double)miss_count/ref_count *100);
-		
 	return(0);
 }
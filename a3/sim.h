@@ -1,33 +1,156 @@
 #ifndef __SIM_H__
 #define __SIM_H__
 
+#include <stdio.h>
+#include <stdlib.h>
 #include "pagetable.h"
+#include "trace.h"
 #define MAXLINE 256
-#define SIMPAGESIZE 16  /* Simulated physical memory page frame size */
+#define SIMPAGESIZE 16  /* Default simulated physical memory page frame size */
+#define MIN_SIMPAGESIZE 16              /* Room for the version and vaddr */
+#define MAX_SIMPAGESIZE (2 * 1024 * 1024)
 
-extern unsigned memsize;
 extern int debug;
-
-extern int hit_count;
-extern int miss_count;
-extern int ref_count;
-extern int evict_clean_count;
-extern int evict_dirty_count;
-
-/* We simulate physical memory with a large array of bytes */
-extern char *physmem;
+extern unsigned sim_pagesize;  // Frame size for simulations created next
+extern int sim_pt_levels;      // Page table levels, likewise
+extern int sim_huge_pages;     // True to map 2 MiB pages, likewise
+extern unsigned sim_tlb_entries; // Entries in each TLB, or 0 for no TLB
+extern unsigned sim_tlb_ways;  // Associativity of the TLBs
+extern int sim_local_replacement; // True to evict only the faulting
+                               // process's own pages
+extern int sim_instrument;     // True to instrument the replay (inst.h)
+extern unsigned long sim_inst_interval; // References between samples of
+                               // the time series, or 0 for none
+extern FILE *sim_inst_out;     // Where the time series goes
 
 // Each eviction algorithm is represented by a structure with its name
 // and three functions.
 struct functions {
 	char *name;                  // String name of eviction algorithm
-	void (*init)(void);          // Initialize any data needed by alg
-	void (*ref)(pgtbl_entry_t *);    // Called on each reference
-	int (*evict)();              // Called to choose victim for eviction
+	void (*init)(struct sim *);  // Initialize any data needed by alg
+	void (*ref)(struct sim *, pgtbl_entry_t *, addr_t); // Called on each
+	                             // reference, with the page's pte and the
+	                             // virtual address being accessed
+	int (*evict)(struct sim *);  // Called to choose victim for eviction
+	int offline;                 // True if alg needs the whole trace up
+	                             // front (in s->trace) to decide
+	void (*destroy)(struct sim *); // Frees anything alg_data points to,
+	                             // or NULL if there is nothing to free
+	int global_only;             // True if evict ignores s->evict_asid,
+	                             // so alg cannot do local replacement
+};
+
+/* A process in the trace, identified by its ASID.
+ */
+struct process {
+	pgdir_entry_t *pgdir;        // Its page directory, or NULL until its
+	                             // first reference
+	unsigned resident;           // Frames holding its pages
+
+	// Counters for its references, and for evictions of its pages.
+	unsigned long hit_count;
+	unsigned long miss_count;
+	unsigned long ref_count;
+	unsigned long evict_count;
+};
+
+/* All of the state for one simulation. Several simulations can replay the
+ * same trace side by side, since nothing here is shared between them.
+ */
+struct sim {
+	unsigned memsize;            // Number of frames of physical memory
+	unsigned pagesize;           // Bytes in each simulated frame
+	char *physmem;               // Simulated physical memory, memsize frames
+	struct coremap coremap;      // Information about each physical frame
+	unsigned *free_frames;       // Stack of free frames, lowest on top
+	unsigned nfree;              // Number of free frames; 0 once memory
+	                             // is full
+	struct process *procs;       // procs[asid], for every possible ASID
+	unsigned nprocs;             // One more than the highest ASID seen
+	int local;                   // True for local replacement
+	int evict_asid;              // The process whose frame evict must
+	                             // choose, or -1 for any frame
+	int pt_levels;               // Levels of tables, counting the leaves
+	int pt_shift[PT_MAX_LEVELS]; // Lowest vaddr bit of each level's index,
+	                             // level 0 being the page directory
+	unsigned pt_entries[PT_MAX_LEVELS]; // Entries in each table of a level
+	unsigned long pt_tables[PT_MAX_LEVELS]; // Tables allocated per level
+	int page_shift;              // log2 of the bytes a leaf entry maps
+	int va_bits;                 // Bits of virtual address translated
+	struct swap *swap;           // Swapfile and its allocation bitmap
+	struct tlb *itlb;            // Instruction and data TLBs, or NULL if
+	struct tlb *dtlb;            // TLBs are not simulated
+
+	const trace_rec_t *trace;    // The whole trace, or NULL if it is being
+	size_t trace_len;            // streamed (only offline algs need it)
+	size_t trace_pos;            // Index in the trace of current reference
+
+	struct functions *alg;       // The replacement algorithm
+	void *alg_data;              // Algorithm state, freed by sim_destroy()
+	                             // after calling alg->destroy
+
+	// Per-simulation random number generator state, so that simulations
+	// running in different threads do not contend on random()'s lock.
+	struct random_data rand_data;
+	int32_t rand_state[32];      // 128 bytes of state, as random() uses
+
+	// Counters for various events.
+	unsigned long hit_count;
+	unsigned long miss_count;
+	unsigned long ref_count;
+	unsigned long evict_clean_count;
+	unsigned long evict_dirty_count;
+	unsigned long evict_scan;    // Frames evict functions have examined
+
+	struct inst *inst;           // Instrumentation, or NULL if it is off
 };
 
-extern void (*init_fcn)();
-extern void (*ref_fcn)(pgtbl_entry_t *);
-extern int (*evict_fcn)();
+/* The value init_frame() stores in a frame, and access_mem() expects to
+ * find there, for an access to vaddr: the start of the page it falls in,
+ * since every address on the page shares the frame. Reduced traces only
+ * hold page-aligned addresses, but the marker stores kept for -M do not.
+ */
+static inline addr_t frame_tag(struct sim *s, addr_t vaddr) {
+	return vaddr & ~(((addr_t)1 << s->page_shift) - 1);
+}
+
+/* Returns true if the replacement algorithm may choose frame as a victim.
+ * Under local replacement a process that faults replaces one of its own
+ * pages, so evict functions pass over other processes' frames.
+ */
+static inline int frame_evictable(struct sim *s, unsigned frame) {
+	return s->evict_asid < 0 || s->coremap.asid[frame] == s->evict_asid;
+}
+
+extern struct functions algs[];
+extern int num_algs;
+
+extern struct sim *sim_create(unsigned memsize, unsigned swapsize,
+		struct functions *alg, const trace_rec_t *trace, size_t trace_len);
+extern void sim_destroy(struct sim *s);
+extern int sim_page_shift(void);
+extern long sim_random(struct sim *s);
+extern struct functions *find_alg(const char *name);
+extern int parse_algs(char *arg, struct functions **selected);
+extern void access_mem(struct sim *s, char type, addr_t vaddr);
+extern void sim_reset_stats(struct sim *s);
+extern void replay_recs(struct sim *s, const trace_rec_t *recs, size_t n);
+extern void replay_trace(struct trace_reader *tr, struct sim **sims, int nsims);
+
+extern void run_sweep(const trace_rec_t *recs, size_t nrecs, size_t warmup,
+		size_t window, unsigned swapsize, struct functions **algs, int nalgs,
+		unsigned first, unsigned last, unsigned step, int nthreads);
+extern void sweep_misses(const trace_rec_t *recs, size_t nrecs, size_t warmup,
+		size_t window, unsigned swapsize, struct functions *alg,
+		unsigned first, unsigned last, unsigned step, int nthreads,
+		unsigned long *misses);
+extern void run_lru_mrc(struct trace_reader *tr, unsigned first, unsigned last,
+		unsigned step);
+extern void run_lru_shards(struct trace_reader *tr, unsigned first,
+		unsigned last, unsigned step, size_t budget, int compare,
+		unsigned swapsize, int nthreads);
+#define WSS_MAX_TAUS 16         // Window sizes run_wss() can follow at once
+extern void run_wss(struct trace_reader *tr, const unsigned long *taus,
+		int ntaus, size_t budget);
 
 #endif // __SIM_H 
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "trace.h"
+
+/* Benchmark driver for the whole simulator.
+ *
+ * Replays every trace with every algorithm at every memory size, through
+ * the same find_physpage() path as sim, and repeats each run to report the
+ * median and the spread of its throughput. Each run is a child process, so
+ * that its peak RSS is its own; it covers the loaded trace as well as the
+ * simulator. The allocator calls it makes, from sim_create() to the end of
+ * the replay, are counted by wrapping malloc and friends at link time (see
+ * the Makefile). Loading the trace is not timed.
+ *
+ * Results go to stdout as a table and, with -o, to a JSON file.
+ *
+ * USAGE: simbench -a algorithm[,algorithm...|all] -m memorysize[,...]
+ *                 [-r repeats] [-s swapsize] [-b file|mmap|ram] [-o out.json]
+ *                 tracefile...
+ */
+#define MAX_MEMSIZES 16
+
+/* What one run of one configuration measured, sent back over a pipe.
+ */
+struct run {
+	double seconds;              // Replay time
+	unsigned long refs;
+	unsigned long misses;
+	unsigned long allocs;        // malloc, calloc, realloc, posix_memalign
+	unsigned long frees;
+	long peak_rss_kib;           // Filled in by the parent
+};
+
+static unsigned long alloc_calls;
+static unsigned long free_calls;
+
+// The real allocator, which the linker's --wrap renames
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t nmemb, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+extern int __real_posix_memalign(void **memptr, size_t align, size_t size);
+extern void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+	__atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	__atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	__atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **memptr, size_t align, size_t size) {
+	__atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+	return __real_posix_memalign(memptr, align, size);
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr != NULL) {
+		__atomic_add_fetch(&free_calls, 1, __ATOMIC_RELAXED);
+	}
+	__real_free(ptr);
+}
+
+/* The child side of a run: loads the trace, replays it, and writes what it
+ * measured to fd.
+ */
+static void run_child(int fd, const char *path, struct functions *alg,
+		unsigned memsize, unsigned swapsize) {
+	struct trace_reader tr;
+	struct run r;
+	struct sim *s;
+	double start;
+
+	if (trace_open(&tr, path) != 0 || trace_load(&tr) != 0) {
+		_exit(1);
+	}
+	memset(&r, 0, sizeof(r));
+	alloc_calls = free_calls = 0;
+	s = sim_create(memsize, swapsize, alg, tr.recs, tr.nrecs);
+	start = trace_now();
+	replay_recs(s, tr.recs, tr.nrecs);
+	r.seconds = trace_now() - start;
+	r.allocs = alloc_calls;
+	r.frees = free_calls;
+	r.refs = s->ref_count;
+	r.misses = s->miss_count;
+	if (write(fd, &r, sizeof(r)) != sizeof(r)) {
+		_exit(1);
+	}
+	// Removes the swapfile
+	sim_destroy(s);
+	_exit(0);
+}
+
+/* Runs one configuration in a child process. Returns 0 on success.
+ */
+static int run_once(const char *path, struct functions *alg, unsigned memsize,
+		unsigned swapsize, struct run *r) {
+	struct rusage ru;
+	int pfd[2], status;
+	pid_t pid;
+	ssize_t got;
+
+	fflush(stdout);
+	if (pipe(pfd) == -1 || (pid = fork()) == -1) {
+		perror("simbench");
+		exit(1);
+	}
+	if (pid == 0) {
+		close(pfd[0]);
+		run_child(pfd[1], path, alg, memsize, swapsize);
+	}
+	close(pfd[1]);
+	got = read(pfd[0], r, sizeof(*r));
+	close(pfd[0]);
+	if (wait4(pid, &status, 0, &ru) == -1 || !WIFEXITED(status) ||
+			WEXITSTATUS(status) != 0 || got != sizeof(*r)) {
+		return -1;
+	}
+	r->peak_rss_kib = ru.ru_maxrss;
+	return 0;
+}
+
+static int by_seconds(const void *a, const void *b) {
+	double x = ((const struct run *)a)->seconds;
+	double y = ((const struct run *)b)->seconds;
+	return (x > y) - (x < y);
+}
+
+// Prints str as a JSON string, escaping quotes, backslashes and control
+// characters
+static void json_string(FILE *fp, const char *str) {
+	const unsigned char *p;
+
+	fputc('"', fp);
+	for (p = (const unsigned char *)str; *p != '\0'; p++) {
+		if (*p == '"' || *p == '\\') {
+			fprintf(fp, "\\%c", *p);
+		} else if (*p < 0x20) {
+			fprintf(fp, "\\u%04x", *p);
+		} else {
+			fputc(*p, fp);
+		}
+	}
+	fputc('"', fp);
+}
+
+// Prints a median/min/max triple as a JSON object
+static void json_stat(FILE *fp, const char *name, double median, double min,
+		double max) {
+	fprintf(fp, "\"%s\": {\"median\": %.6g, \"min\": %.6g, \"max\": %.6g}",
+			name, median, min, max);
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	int i, t, m, k, nalgs, nmem = 0;
+	int repeats = 5;
+	unsigned memsizes[MAX_MEMSIZES];
+	unsigned swapsize = 1 << 20;   // Room for the pages of big traces
+	char *alg_arg = NULL;
+	char *outfile = NULL;
+	char *mem, *save, *end;
+	struct functions **selected;
+	struct run *runs;
+	FILE *json = NULL;
+	int first = 1;
+	char *usage = "USAGE: simbench -a algorithm[,algorithm...|all] -m memorysize[,...] [-r repeats] [-s swapsize] [-b file|mmap|ram] [-o out.json] tracefile...\n";
+
+	while ((opt = getopt(argc, argv, "a:m:r:s:b:o:")) != -1) {
+		switch (opt) {
+		case 'a':
+			alg_arg = optarg;
+			break;
+		case 'm':
+			for (mem = strtok_r(optarg, ",", &save); mem != NULL;
+					mem = strtok_r(NULL, ",", &save)) {
+				if (nmem == MAX_MEMSIZES) {
+					fprintf(stderr, "Error: at most %d memory sizes\n",
+							MAX_MEMSIZES);
+					exit(1);
+				}
+				memsizes[nmem] = (unsigned)strtoul(mem, &end, 10);
+				if (*end != '\0' || memsizes[nmem] == 0) {
+					fprintf(stderr, "Error: bad memory size '%s'\n", mem);
+					exit(1);
+				}
+				nmem++;
+			}
+			break;
+		case 'r':
+			repeats = (int)strtol(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || repeats < 1) {
+				fprintf(stderr, "Error: bad repeat count '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 's':
+			swapsize = (unsigned)strtoul(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || swapsize == 0) {
+				fprintf(stderr, "Error: bad swap size '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'b':
+			if (swap_set_backend(optarg) != 0) {
+				exit(1);
+			}
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (alg_arg == NULL || nmem == 0 || repeats < 1 || optind == argc) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+	selected = malloc(num_algs * sizeof(struct functions *));
+	runs = malloc(repeats * sizeof(struct run));
+	nalgs = parse_algs(alg_arg, selected);
+	if (outfile != NULL && (json = fopen(outfile, "w")) == NULL) {
+		perror("Error opening outfile");
+		exit(1);
+	}
+
+	printf("%-24s %-8s %8s %10s %12s %8s %14s %7s %10s %10s\n", "trace",
+			"alg", "memsize", "refs", "misses", "ns/ref", "refs/sec",
+			"spread", "RSS KiB", "allocs");
+	if (json != NULL) {
+		fprintf(json, "{\n  \"repeats\": %d,\n  \"results\": [", repeats);
+	}
+	for (t = optind; t < argc; t++) {
+		for (m = 0; m < nmem; m++) {
+			for (i = 0; i < nalgs; i++) {
+				struct run *med;
+				double spread;
+
+				for (k = 0; k < repeats; k++) {
+					if (run_once(argv[t], selected[i], memsizes[m], swapsize,
+							&runs[k]) != 0) {
+						fprintf(stderr, "simbench: %s on %s with %u frames failed\n",
+								selected[i]->name, argv[t], memsizes[m]);
+						exit(1);
+					}
+				}
+				qsort(runs, repeats, sizeof(struct run), by_seconds);
+				med = &runs[repeats / 2];
+				if (med->refs == 0) {
+					fprintf(stderr, "simbench: %s has no references\n",
+							argv[t]);
+					exit(1);
+				}
+				spread = (runs[repeats - 1].seconds - runs[0].seconds) /
+						med->seconds * 100;
+
+				printf("%-24s %-8s %8u %10lu %12lu %8.1f %14.0f %6.1f%% %10ld %10lu\n",
+						argv[t], selected[i]->name, memsizes[m], med->refs,
+						med->misses, med->seconds * 1e9 / med->refs,
+						med->refs / med->seconds, spread, med->peak_rss_kib,
+						med->allocs);
+				if (json == NULL) {
+					continue;
+				}
+				fprintf(json, "%s\n    {\"trace\": ", first ? "" : ",");
+				json_string(json, argv[t]);
+				fprintf(json, ", \"alg\": \"%s\", "
+						"\"memsize\": %u, \"refs\": %lu, \"misses\": %lu,\n     ",
+						selected[i]->name, memsizes[m], med->refs, med->misses);
+				json_stat(json, "ns_per_ref", med->seconds * 1e9 / med->refs,
+						runs[0].seconds * 1e9 / med->refs,
+						runs[repeats - 1].seconds * 1e9 / med->refs);
+				fprintf(json, ",\n     ");
+				json_stat(json, "refs_per_sec", med->refs / med->seconds,
+						med->refs / runs[repeats - 1].seconds,
+						med->refs / runs[0].seconds);
+				fprintf(json, ",\n     \"spread_pct\": %.2f, "
+						"\"peak_rss_kib\": %ld, \"allocs\": %lu, \"frees\": %lu}",
+						spread, med->peak_rss_kib, med->allocs, med->frees);
+				first = 0;
+			}
+		}
+	}
+	if (json != NULL) {
+		fprintf(json, "\n  ]\n}\n");
+		if (fclose(json) != 0) {
+			perror("Error writing outfile");
+			exit(1);
+		}
+	}
+
+	free(runs);
+	free(selected);
+	return 0;
+}
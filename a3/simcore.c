@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "trace.h"
+#include "tlb.h"
+#include "inst.h"
+
+// Define global variables declared in sim.h
+int debug = 0;
+unsigned sim_pagesize = SIMPAGESIZE;
+int sim_pt_levels = 2;
+int sim_huge_pages = 0;
+unsigned sim_tlb_entries = 0;
+unsigned sim_tlb_ways = 4;
+int sim_local_replacement = 0;
+int sim_instrument = 0;
+unsigned long sim_inst_interval = 0;
+FILE *sim_inst_out = NULL;
+
+/* The algs array gives us a mapping between the name of an eviction
+ * algorithm as given in a command line argument, and the function to
+ * call to select the victim page.
+ */
+struct functions algs[] = {
+	{"rand", rand_init, rand_ref, rand_evict},
+	{"lru", lru_init, lru_ref, lru_evict},
+	{"fifo", fifo_init, fifo_ref, fifo_evict},
+	{"clock",clock_init, clock_ref, clock_evict},
+	{"opt", opt_init, opt_ref, opt_evict, 1},
+	{"gclock", gclock_init, gclock_ref, gclock_evict},
+	{"clockpro", clockpro_init, clockpro_ref, clockpro_evict, 0,
+		clockpro_destroy, 1},
+	{"arc", arc_init, arc_ref, arc_evict, 0, arc_destroy, 1},
+	{"2q", twoq_init, twoq_ref, twoq_evict, 0, twoq_destroy, 1},
+};
+int num_algs = sizeof(algs) / sizeof(algs[0]);
+
+
+/* Creates a simulation with its own physical memory, coremap, page directory
+ * and swapfile, using the given replacement algorithm.
+ * trace is the whole trace if it has been loaded, or NULL if it will be
+ * streamed; offline algorithms require it.
+ */
+struct sim *sim_create(unsigned memsize, unsigned swapsize,
+		struct functions *alg, const trace_rec_t *trace, size_t trace_len) {
+	struct sim *s = calloc(1, sizeof(struct sim));
+	if (s == NULL) {
+		perror("Failed to allocate simulation");
+		exit(1);
+	}
+	s->memsize = memsize;
+	s->alg = alg;
+	s->trace = trace;
+	s->trace_len = trace_len;
+	if (alg->offline && trace == NULL) {
+		fprintf(stderr, "Error: %s needs the whole trace in advance\n",
+				alg->name);
+		exit(1);
+	}
+	s->local = sim_local_replacement;
+	s->evict_asid = -1;
+	if (s->local && alg->global_only) {
+		fprintf(stderr, "Error: %s only supports global replacement\n",
+				alg->name);
+		exit(1);
+	}
+
+	// Initialize main data structures for simulation.
+	// This happens before calling the replacement algorithm init function
+	// so that the init function can refer to the coremap if needed.
+	init_coremap(s);
+	// Anonymous memory is page-aligned and starts out zero, which lets
+	// init_frame() zero large frames lazily
+	s->pagesize = sim_pagesize;
+	s->physmem = mmap(NULL, (size_t)memsize * s->pagesize,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (s->physmem == MAP_FAILED) {
+		s->physmem = NULL;
+	}
+	s->free_frames = malloc(memsize * sizeof(unsigned));
+	if (s->physmem == NULL || s->free_frames == NULL) {
+		perror("Failed to allocate physical memory");
+		exit(1);
+	}
+	// Frames are handed out in increasing order, as a scan of the coremap
+	// would, so that algorithms like fifo can rely on it
+	for (s->nfree = 0; s->nfree < memsize; s->nfree++) {
+		s->free_frames[s->nfree] = memsize - 1 - s->nfree;
+	}
+	swap_init(s, swapsize);
+	init_pagetable(s);
+	if (sim_tlb_entries > 0) {
+		s->itlb = tlb_create(sim_tlb_entries, sim_tlb_ways);
+		s->dtlb = tlb_create(sim_tlb_entries, sim_tlb_ways);
+	}
+
+	// Same sequence as an unseeded random(), but private to this simulation
+	initstate_r(1, (char *)s->rand_state, sizeof(s->rand_state),
+			&s->rand_data);
+
+	if (sim_instrument) {
+		s->inst = inst_create(sim_inst_interval, sim_inst_out);
+	}
+
+	// Call replacement algorithm's init function before replaying trace.
+	alg->init(s);
+	return s;
+}
+
+/* Frees everything owned by the simulation and removes its swapfile.
+ */
+void sim_destroy(struct sim *s) {
+	swap_destroy(s);
+	free_pagetable(s);
+	if (s->itlb != NULL) {
+		tlb_destroy(s->itlb);
+		tlb_destroy(s->dtlb);
+	}
+	if (s->alg->destroy != NULL) {
+		s->alg->destroy(s);
+	}
+	free(s->alg_data);
+	munmap(s->physmem, (size_t)s->memsize * s->pagesize);
+	free(s->free_frames);
+	free_coremap(s);
+	inst_destroy(s->inst);
+	free(s);
+}
+
+/* Returns log2 of the bytes of virtual memory in a page, for simulations
+ * created next and for the trace analyses: 4 KiB, or 2 MiB with
+ * sim_huge_pages.
+ */
+int sim_page_shift(void) {
+	return sim_huge_pages ? HUGE_PAGE_SHIFT : PAGE_SHIFT;
+}
+
+/* Returns the next number from this simulation's random number generator,
+ * in the same range as random().
+ */
+long sim_random(struct sim *s) {
+	int32_t result;
+	random_r(&s->rand_data, &result);
+	return result;
+}
+
+/* Looks up an eviction algorithm by name. Returns NULL if there is none.
+ */
+struct functions *find_alg(const char *name) {
+	int i;
+	for (i = 0; i < num_algs; i++) {
+		if(strcmp(algs[i].name, name) == 0) {
+			return &algs[i];
+		}
+	}
+	return NULL;
+}
+
+/* Parses the -a argument, which is a single algorithm name, a comma
+ * separated list of names, or "all". Under local replacement, "all" leaves
+ * out the algorithms that only support global replacement.
+ * Returns the number of algorithms stored in selected.
+ */
+int parse_algs(char *arg, struct functions **selected) {
+	int n = 0, i;
+	char *name;
+
+	if (strcmp(arg, "all") == 0) {
+		for (i = 0; i < num_algs; i++) {
+			if (!(sim_local_replacement && algs[i].global_only)) {
+				selected[n++] = &algs[i];
+			}
+		}
+		return n;
+	}
+	for (name = strtok(arg, ","); name != NULL; name = strtok(NULL, ",")) {
+		if (n == num_algs || (selected[n] = find_alg(name)) == NULL) {
+			fprintf(stderr, "Error: invalid replacement algorithm - %s\n",
+					name);
+			exit(1);
+		}
+		n++;
+	}
+	return n;
+}
+
+
+/* An actual memory access based on the vaddr from the trace file.
+ *
+ * The find_physpage() function is called to translate the virtual address
+ * to a (simulated) physical address -- that is, a pointer to the right
+ * location in physmem array. The find_physpage() function is responsible for
+ * everything to do with memory management - including translation using the
+ * pagetable, allocating a frame of (simulated) physical memory (if needed),
+ * evicting an existing page from the frame (if needed) and reading the page
+ * in from swap (if needed).
+ *
+ * We then check that the memory has the expected content (just a copy of the
+ * virtual address) and, in case of a write reference, increment the version
+ * counter.
+ */
+void access_mem(struct sim *s, char type, addr_t vaddr) {
+	char *memptr = find_physpage(s, vaddr, type);
+	int *versionptr = (int *)memptr;
+	addr_t *checkaddr = (addr_t *)(memptr + sizeof(int));
+
+	if (*checkaddr != frame_tag(s, vaddr)) {
+		fprintf(stderr,"Error, simulated page returned by pagetable lookup doese not have expected value.\n");
+	}
+
+	if (type == 'S' || type == 'M') {
+		// write access to page, increment version number
+		(*versionptr)++;
+	}
+
+}
+
+
+/* replay_recs() with the instrumentation on: times each reference, and
+ * samples the counters every s->inst->interval references.
+ */
+static void replay_recs_inst(struct sim *s, const trace_rec_t *recs,
+		size_t n) {
+	struct inst *inst = s->inst;
+	size_t i;
+
+	for(i = 0; i < n; i++) {
+		char type = TREC_TYPE(recs[i]);
+		addr_t vaddr = TREC_VADDR(recs[i]);
+		uint64_t start;
+		if(debug)  {
+			printf("%c %lx\n", type, vaddr);
+		}
+		start = inst_now();
+		access_mem(s, type, vaddr);
+		inst_add(inst, STAGE_FIND, start);
+		s->trace_pos++;
+		if (inst->interval > 0 && s->ref_count >= inst->next_sample) {
+			inst_sample(s);
+		}
+	}
+}
+
+/* Replays n already-decoded trace records against one simulation.
+ */
+void replay_recs(struct sim *s, const trace_rec_t *recs, size_t n) {
+	size_t i;
+
+	if (s->inst != NULL) {
+		replay_recs_inst(s, recs, n);
+		return;
+	}
+	for(i = 0; i < n; i++) {
+		char type = TREC_TYPE(recs[i]);
+		addr_t vaddr = TREC_VADDR(recs[i]);
+		if(debug)  {
+			printf("%c %lx\n", type, vaddr);
+		}
+		access_mem(s, type, vaddr);
+		s->trace_pos++;
+	}
+}
+
+/* Zeroes the simulation's counters, and those of its processes and TLBs,
+ * so that they count only what follows. The swap I/O statistics are left
+ * alone, since they measure the cost of the whole run.
+ */
+void sim_reset_stats(struct sim *s) {
+	unsigned asid;
+
+	s->hit_count = 0;
+	s->miss_count = 0;
+	s->ref_count = 0;
+	s->evict_clean_count = 0;
+	s->evict_dirty_count = 0;
+	for (asid = 0; asid < s->nprocs; asid++) {
+		s->procs[asid].hit_count = 0;
+		s->procs[asid].miss_count = 0;
+		s->procs[asid].ref_count = 0;
+		s->procs[asid].evict_count = 0;
+	}
+	if (s->itlb != NULL) {
+		s->itlb->hits = s->itlb->misses = s->itlb->shootdowns = 0;
+		s->dtlb->hits = s->dtlb->misses = s->dtlb->shootdowns = 0;
+	}
+	if (s->inst != NULL) {
+		inst_reset(s->inst);
+	}
+}
+
+/* Replays every reference in the trace against each of the nsims
+ * simulations. The reader hands out batches of already-decoded records, so
+ * the trace is decoded once no matter how many simulations are fed, and
+ * there is no per-line parsing here.
+ *
+ * If the trace is bounded by markers, the warm-up references are replayed
+ * and then forgotten by the counters, and the replay stops at the end of
+ * the window.
+ */
+void replay_trace(struct trace_reader *tr, struct sim **sims, int nsims) {
+	const trace_rec_t *recs;
+	size_t n, k;
+	int j, phase = WINDOW_WARMUP;
+
+	while(phase != WINDOW_DONE && (n = trace_next(tr, &recs)) > 0) {
+		for (; n > 0; recs += k, n -= k) {
+			int prev = phase;
+			k = trace_window(tr, recs, n, &phase);
+			if (phase == WINDOW_DONE) {
+				break;
+			}
+			for(j = 0; j < nsims; j++) {
+				if (phase != prev) {
+					sim_reset_stats(sims[j]);
+				}
+				replay_recs(sims[j], recs, k);
+			}
+		}
+	}
+}
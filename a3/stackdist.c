@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stackdist.h"
+
+static void tree_add(struct stackdist *sd, uint64_t t, int delta) {
+    uint64_t i;
+    for (i = t + 1; i <= sd->cap; i += i & -i) {
+        sd->tree[i] += delta;
+    }
+}
+
+// Number of marks at times [0, t]
+static unsigned tree_sum(struct stackdist *sd, uint64_t t) {
+    unsigned sum = 0;
+    uint64_t i;
+    for (i = t + 1; i > 0; i -= i & -i) {
+        sum += sd->tree[i];
+    }
+    return sum;
+}
+
+/* Renumbers the last-reference times of all pages to 0..count-1, keeping
+ * their order, and rebuilds the tree with room for as many new references.
+ */
+static void stackdist_compact(struct stackdist *sd) {
+    struct pagemap *pm = &sd->last;
+    uint64_t count = pm->count;
+    unsigned *rank;
+    uint64_t t, r, i;
+
+    // rank[t] = new time for the page last referenced at old time t
+    rank = calloc(sd->cap, sizeof(unsigned));
+    if (rank == NULL) {
+        perror("stackdist: calloc");
+        exit(1);
+    }
+    for (i = 0; i < pm->cap; i++) {
+        if (pm->keys[i] != PAGEMAP_EMPTY) {
+            rank[pm->vals[i]] = 1;
+        }
+    }
+    for (t = 0, r = 0; t < sd->cap; t++) {
+        if (rank[t]) {
+            rank[t] = r++;
+        }
+    }
+    for (i = 0; i < pm->cap; i++) {
+        if (pm->keys[i] != PAGEMAP_EMPTY) {
+            pm->vals[i] = rank[pm->vals[i]];
+        }
+    }
+    free(rank);
+
+    // Marks at 0..count-1, built in linear time
+    sd->cap = 2 * count > STACKDIST_MIN_CAP ? 2 * count : STACKDIST_MIN_CAP;
+    free(sd->tree);
+    sd->tree = calloc(sd->cap + 1, sizeof(unsigned));
+    if (sd->tree == NULL) {
+        perror("stackdist: calloc");
+        exit(1);
+    }
+    for (i = 1; i <= sd->cap; i++) {
+        uint64_t parent = i + (i & -i);
+        if (i <= count) {
+            sd->tree[i] += 1;
+        }
+        if (parent <= sd->cap) {
+            sd->tree[parent] += sd->tree[i];
+        }
+    }
+    sd->now = count;
+}
+
+void stackdist_init(struct stackdist *sd) {
+    memset(sd, 0, sizeof(*sd));
+    pagemap_init(&sd->last, STACKDIST_MIN_CAP);
+    sd->cap = STACKDIST_MIN_CAP;
+    sd->tree = calloc(sd->cap + 1, sizeof(unsigned));
+    if (sd->tree == NULL) {
+        perror("stackdist: calloc");
+        exit(1);
+    }
+}
+
+void stackdist_destroy(struct stackdist *sd) {
+    pagemap_destroy(&sd->last);
+    free(sd->tree);
+    sd->tree = NULL;
+}
+
+/* Records a reference to virtual page vpn. Returns its stack distance, or
+ * 0 if this is the first reference to the page.
+ */
+size_t stackdist_ref(struct stackdist *sd, uint64_t vpn) {
+    int found;
+    uint64_t *last;
+    size_t d = 0;
+
+    if (sd->now == sd->cap) {
+        stackdist_compact(sd);
+    }
+
+    last = pagemap_insert(&sd->last, vpn, &found);
+    if (found) {
+        // Distinct pages referenced after *last, plus this page itself
+        d = sd->last.count - tree_sum(sd, *last) + 1;
+        tree_add(sd, *last, -1);
+    }
+
+    *last = sd->now;
+    tree_add(sd, sd->now, 1);
+    sd->now++;
+    return d;
+}
+
+/* Forgets vpn, as if it had never been referenced. The distances of other
+ * pages no longer count it.
+ */
+void stackdist_remove(struct stackdist *sd, uint64_t vpn) {
+    uint64_t *last = pagemap_find(&sd->last, vpn);
+
+    if (last != NULL) {
+        tree_add(sd, *last, -1);
+        pagemap_remove(&sd->last, vpn);
+    }
+}
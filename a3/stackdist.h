@@ -0,0 +1,33 @@
+#ifndef __STACKDIST_H__
+#define __STACKDIST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pagemap.h"
+
+/* LRU stack distances in O(log n) per reference.
+ *
+ * The stack distance of a reference is the number of distinct pages
+ * referenced since the previous reference to the same page, plus one. It
+ * is computed with a Fenwick tree over access times: each page has a mark
+ * at the time of its last reference, so the number of marks after that
+ * time is the number of distinct pages referenced since. When the clock
+ * reaches the end of the tree, the live times are renumbered
+ * 0..footprint-1, so the tree stays proportional to the number of distinct
+ * pages rather than the length of the trace.
+ */
+#define STACKDIST_MIN_CAP 1024
+
+struct stackdist {
+    struct pagemap last;        // Page number -> time of its last reference
+    unsigned *tree;             // Fenwick tree over access times, 1-based
+    uint64_t cap;               // The tree covers times [0, cap)
+    uint64_t now;               // Time of the next reference
+};
+
+extern void stackdist_init(struct stackdist *sd);
+extern void stackdist_destroy(struct stackdist *sd);
+extern size_t stackdist_ref(struct stackdist *sd, uint64_t vpn);
+extern void stackdist_remove(struct stackdist *sd, uint64_t vpn);
+
+#endif /* __STACKDIST_H__ */
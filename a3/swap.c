@@ -1,3 +1,4 @@
+#define _GNU_SOURCE      // For qsort_r()
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -5,6 +6,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <pthread.h>
 #include "pagetable.h"
 #include "sim.h"
 
@@ -14,48 +20,68 @@
 // on demand with a little effort.
 //
 // The bitmap code is modified from the OS/161 bitmap functions.
+// It uses 64-bit words and a summary level with one bit per word, set
+// when the word is full, so a free bit is found with two count-trailing-
+// zeros instructions instead of a bit-by-bit scan. hint is the first
+// summary word that may have a clear bit (all words before it are full),
+// which keeps allocation near-constant time even with tens of millions
+// of slots, while still returning the lowest free index.
 
-#define BITS_PER_WORD 32 // Assumes sizeof(unsigned) = 4 bytes, 32 bits
-#define WORD_ALLBITS    (0xffffffff)
+#define BITS_PER_WORD 64
+#define WORD_ALLBITS    (~(uint64_t)0)
 
 #define DIVROUNDUP(a,b) (((a)+(b)-1)/(b))
 
 struct bitmap {
         unsigned nbits;
-        unsigned *v;
+        unsigned nwords;        /* Words in v */
+        uint64_t *v;
+        uint64_t *summary;      /* Bit i set iff v[i] is full */
+        unsigned hint;          /* Summary words before this are full */
 };
 
 struct bitmap *
 bitmap_create(unsigned nbits)
 {
         struct bitmap *b; 
-        unsigned words;
+        size_t words, swords;
 
-        words = DIVROUNDUP(nbits, BITS_PER_WORD);
+        /* In size_t, so nbits near UINT_MAX does not wrap */
+        words = DIVROUNDUP((size_t)nbits, BITS_PER_WORD);
+        swords = DIVROUNDUP(words, BITS_PER_WORD);
         b = (struct bitmap *)malloc(sizeof(struct bitmap));
         if (b == NULL) {
                 return NULL;
         }
-        b->v = malloc(words*sizeof(unsigned));
-        if (b->v == NULL) {
+        b->v = calloc(words, sizeof(uint64_t));
+        b->summary = calloc(swords, sizeof(uint64_t));
+        if (b->v == NULL || b->summary == NULL) {
+                free(b->v);
+                free(b->summary);
                 free(b);
                 return NULL;
         }
-
-        memset(b->v, 0, words*sizeof(unsigned));
         b->nbits = nbits;
+        b->nwords = words;
+        b->hint = 0;
 
         /* Mark any leftover bits at the end in use */
         if (words > nbits / BITS_PER_WORD) {
-                unsigned j, ix = words-1;
+                unsigned ix = words-1;
                 unsigned overbits = nbits - ix*BITS_PER_WORD;
 
                 assert(nbits / BITS_PER_WORD == words-1);
                 assert(overbits > 0 && overbits < BITS_PER_WORD);
-                
-                for (j=overbits; j<BITS_PER_WORD; j++) {
-                        b->v[ix] |= ((unsigned)1 << j);
-                }
+
+                b->v[ix] = WORD_ALLBITS << overbits;
+        }
+
+        /* Likewise for the summary bits of words that do not exist */
+        if (swords > words / BITS_PER_WORD) {
+                unsigned ix = swords-1;
+                unsigned overbits = words - ix*BITS_PER_WORD;
+
+                b->summary[ix] = WORD_ALLBITS << overbits;
         }
 
         return b;
@@ -64,63 +90,70 @@ bitmap_create(unsigned nbits)
 int
 bitmap_alloc(struct bitmap *b, unsigned *index)
 {
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        unsigned swords = DIVROUNDUP(b->nwords, BITS_PER_WORD);
+        unsigned ix, offset;
+
+        while (b->hint < swords && b->summary[b->hint] == WORD_ALLBITS) {
+                b->hint++;
+        }
+        if (b->hint == swords) {
+                return 1;
+        }
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                unsigned mask = ((unsigned)1) << offset;
-
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        assert(*index < b->nbits);
-                                        return 0;
-                                }
-                        }
-                        assert(0);
-                }
+        ix = b->hint*BITS_PER_WORD + __builtin_ctzll(~b->summary[b->hint]);
+        offset = __builtin_ctzll(~b->v[ix]);
+        b->v[ix] |= (uint64_t)1 << offset;
+        if (b->v[ix] == WORD_ALLBITS) {
+                b->summary[b->hint] |= (uint64_t)1 << (ix % BITS_PER_WORD);
         }
-        return 1;
+        *index = (ix*BITS_PER_WORD)+offset;
+        assert(*index < b->nbits);
+        return 0;
 }
 
 static
 inline
 void
-bitmap_translate(unsigned bitno, unsigned *ix, unsigned *mask)
+bitmap_translate(unsigned bitno, unsigned *ix, uint64_t *mask)
 {
         unsigned offset;
         *ix = bitno / BITS_PER_WORD;
         offset = bitno % BITS_PER_WORD;
-        *mask = ((unsigned)1) << offset;
+        *mask = ((uint64_t)1) << offset;
 }
 
 void
 bitmap_mark(struct bitmap *b, unsigned index)
 {
         unsigned ix;
-        unsigned mask;
+        uint64_t mask;
 
         assert(index < b->nbits);
         bitmap_translate(index, &ix, &mask);
 
         assert((b->v[ix] & mask)==0);
         b->v[ix] |= mask;
+        if (b->v[ix] == WORD_ALLBITS) {
+                b->summary[ix / BITS_PER_WORD] |=
+                        (uint64_t)1 << (ix % BITS_PER_WORD);
+        }
 }
 
 void
 bitmap_unmark(struct bitmap *b, unsigned index)
 {
         unsigned ix;
-        unsigned mask;
+        uint64_t mask;
 
         assert(index < b->nbits);
         bitmap_translate(index, &ix, &mask);
 
         assert((b->v[ix] & mask)!=0);
         b->v[ix] &= ~mask;
+        b->summary[ix / BITS_PER_WORD] &= ~((uint64_t)1 << (ix % BITS_PER_WORD));
+        if (ix / BITS_PER_WORD < b->hint) {
+                b->hint = ix / BITS_PER_WORD;
+        }
 }
 
 
@@ -128,56 +161,497 @@ int
 bitmap_isset(struct bitmap *b, unsigned index) 
 {
         unsigned ix;
-        unsigned mask;
+        uint64_t mask;
 
         bitmap_translate(index, &ix, &mask);
-        return (b->v[ix] & mask);
+        return (b->v[ix] & mask) != 0;
 }
 
 void
 bitmap_destroy(struct bitmap *b)
 {
         free(b->v);
+        free(b->summary);
         free(b);
 }
 
 //---------------------------------------------------------------------
-// Swap definitions and functions.
-
-static int swapfd;
-static struct bitmap *swapmap;
-static char *fname;
+// Swap backends: where the contents of evicted pages are kept.
+//
+//  file - a temporary swapfile accessed with pread/pwrite, one system
+//         call per page transfer
+//  mmap - the same swapfile mapped into memory, so transfers are memcpy
+//  ram  - an array in memory, with no file at all
+//
+// The backend is chosen once with swap_set_backend() and applies to every
+// simulation created afterwards.
+
+struct swap;
+
+struct swap_backend {
+	char *name;
+	int (*open)(struct swap *sw, size_t bytes);
+	// Copy one page between buf and 'offset' in the backing store,
+	// returning 0 on success
+	int (*read)(struct swap *sw, char *buf, off_t offset);
+	int (*write)(struct swap *sw, const char *buf, off_t offset);
+	void (*close)(struct swap *sw, size_t bytes);
+};
 
-int swap_init(unsigned swapsize) {
+// Each simulation has its own swapfile, so that several simulations can
+// run side by side.
+struct swap {
+	int swapfd;
+	struct bitmap *swapmap;
+	char fname[20];
+	struct swap_backend *backend;
+	char *mem;           // Backing store of the mmap and ram backends
+	size_t bytes;        // Size of the backing store
+	unsigned pagesize;   // Bytes in each page, as in the simulation
+	double io_time;      // Seconds spent in page transfers
+	unsigned long io_bytes; // Bytes transferred
+	struct writeback *wb; // Queue of pending writes, or NULL if writes
+	                     // are synchronous
+};
 
-	// Initialize the swap file
-	fname = malloc(20);
-	strncpy(fname, "swapfile.XXXXXX",20);
-	if ((swapfd = mkstemp(fname)) == -1) {
+// Creates the temporary swapfile, which is removed again by file_close()
+static int file_open(struct swap *sw, size_t bytes) {
+	strncpy(sw->fname, "swapfile.XXXXXX",20);
+	if ((sw->swapfd = mkstemp(sw->fname)) == -1) {
 		perror("Failed to create temporary file for swap");
+		return -1;
+	}
+	return 0;
+}
+
+static int file_read(struct swap *sw, char *buf, off_t offset) {
+	ssize_t bytes_read = pread(sw->swapfd, buf, sw->pagesize, offset);
+	if (bytes_read != (ssize_t)sw->pagesize) {
+		if (bytes_read < 0) {
+			perror("swap_pagein: read failed");
+			return -errno;
+		}
+		fprintf(stderr,"swap_pagein: did not read whole page\n");
+		return bytes_read;
+	}
+	return 0;
+}
+
+static int file_write(struct swap *sw, const char *buf, off_t offset) {
+	if (pwrite(sw->swapfd, buf, sw->pagesize, offset)
+			!= (ssize_t)sw->pagesize) {
+		fprintf(stderr,"swap_pageout: did not write whole page\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void file_close(struct swap *sw, size_t bytes) {
+	close(sw->swapfd);
+	unlink(sw->fname);
+}
+
+static int mmap_open(struct swap *sw, size_t bytes) {
+	if (file_open(sw, bytes) != 0) {
+		return -1;
+	}
+	if (ftruncate(sw->swapfd, bytes) != 0) {
+		perror("Failed to size swapfile");
+		return -1;
+	}
+	sw->mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+			sw->swapfd, 0);
+	if (sw->mem == MAP_FAILED) {
+		perror("Failed to map swapfile");
+		return -1;
+	}
+	return 0;
+}
+
+static void mmap_close(struct swap *sw, size_t bytes) {
+	munmap(sw->mem, bytes);
+	file_close(sw, bytes);
+}
+
+static int ram_open(struct swap *sw, size_t bytes) {
+	sw->swapfd = -1;
+	if ((sw->mem = malloc(bytes)) == NULL) {
+		perror("Failed to allocate swap memory");
+		return -1;
+	}
+	return 0;
+}
+
+static void ram_close(struct swap *sw, size_t bytes) {
+	free(sw->mem);
+}
+
+// Transfers for both backends that keep swap in memory
+static int mem_read(struct swap *sw, char *buf, off_t offset) {
+	memcpy(buf, sw->mem + offset, sw->pagesize);
+	return 0;
+}
+
+static int mem_write(struct swap *sw, const char *buf, off_t offset) {
+	memcpy(sw->mem + offset, buf, sw->pagesize);
+	return 0;
+}
+
+static struct swap_backend swap_backends[] = {
+	{"file", file_open, file_read, file_write, file_close},
+	{"mmap", mmap_open, mem_read, mem_write, mmap_close},
+	{"ram", ram_open, mem_read, mem_write, ram_close},
+};
+
+static struct swap_backend *swap_backend = &swap_backends[0];
+
+//---------------------------------------------------------------------
+// Writeback queue for the file backend.
+//
+// Dirty victims are copied into a staging batch instead of being written
+// at once. A full batch is handed to a writer thread, which sorts it by
+// offset and writes each run of adjacent slots with one pwritev, while the
+// simulation fills the other batch. A page being read back may still be
+// in either batch, so swap_pagein() looks there first; the filling batch
+// holds the newest data and is searched before the one being written.
+// Only the simulation thread ever changes a batch's contents, and only
+// while the writer is not using it, so lookups need no locking.
+
+struct wb_batch {
+	unsigned n;          // Pages in the batch
+	off_t *offs;         // offs[i] = swap offset of page i
+	char *data;          // Page i is at data + i * pagesize
+};
+
+struct writeback {
+	unsigned batch_size;
+	unsigned pagesize;
+	struct wb_batch batches[2];
+	struct wb_batch *filling;    // Being filled by the simulation
+	struct wb_batch *other;      // Handed to the writer, or already written
+	int fd;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct wb_batch *inflight;   // Batch the writer owns, or NULL
+	int stop;                    // Tells the writer to exit
+
+	// Counters, for swap_print_stats()
+	unsigned long nbatches;      // Batches written
+	unsigned long npages;        // Pages in those batches
+	unsigned long nwrites;       // pwritev calls
+	unsigned long nmerged;       // Writes absorbed by a queued page
+	unsigned long nqueue_hits;   // Pageins served from the queue
+	double write_time;           // Writer thread time in pwritev
+	double stall_time;           // Simulation time waiting for the writer
+};
+
+static unsigned writeback_batch = 0;         // 0 means synchronous writes
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Orders indices into a batch by their swap offsets, passed as arg, so
+// that every simulation's writer thread can sort its own batches
+static int wb_cmp(const void *a, const void *b, void *arg) {
+	const off_t *offs = arg;
+	off_t x = offs[*(const unsigned *)a];
+	off_t y = offs[*(const unsigned *)b];
+	return (x > y) - (x < y);
+}
+
+// Writes a batch, coalescing adjacent slots. Runs on the writer thread.
+static void wb_write_batch(struct writeback *wb, struct wb_batch *b,
+		unsigned *order, struct iovec *iov) {
+	unsigned i, j, k;
+
+	for (i = 0; i < b->n; i++) {
+		order[i] = i;
+	}
+	qsort_r(order, b->n, sizeof(unsigned), wb_cmp, b->offs);
+
+	for (i = 0; i < b->n; i = j) {
+		off_t start = b->offs[order[i]];
+		ssize_t len = 0;
+		for (j = i; j < b->n && j - i < IOV_MAX
+				&& b->offs[order[j]] == start + len; j++) {
+			k = j - i;
+			iov[k].iov_base = b->data + (size_t)order[j] * wb->pagesize;
+			iov[k].iov_len = wb->pagesize;
+			len += wb->pagesize;
+		}
+		if (pwritev(wb->fd, iov, j - i, start) != len) {
+			perror("swap writeback: pwritev");
+			exit(1);
+		}
+		wb->nwrites++;
+	}
+	wb->nbatches++;
+	wb->npages += b->n;
+}
+
+static void *wb_writer(void *arg) {
+	struct writeback *wb = arg;
+	unsigned *order = malloc(wb->batch_size * sizeof(unsigned));
+	struct iovec *iov = malloc(wb->batch_size * sizeof(struct iovec));
+	struct wb_batch *b;
+	double start;
+
+	if (order == NULL || iov == NULL) {
+		perror("swap writeback: malloc");
+		exit(1);
+	}
+	pthread_mutex_lock(&wb->lock);
+	for (;;) {
+		while (wb->inflight == NULL && !wb->stop) {
+			pthread_cond_wait(&wb->cond, &wb->lock);
+		}
+		if ((b = wb->inflight) == NULL) {
+			break;
+		}
+		pthread_mutex_unlock(&wb->lock);
+
+		start = trace_now();
+		wb_write_batch(wb, b, order, iov);
+		wb->write_time += trace_now() - start;
+
+		pthread_mutex_lock(&wb->lock);
+		wb->inflight = NULL;
+		pthread_cond_broadcast(&wb->cond);
+	}
+	pthread_mutex_unlock(&wb->lock);
+	free(order);
+	free(iov);
+	return NULL;
+}
+
+// Hands the filling batch to the writer, waiting for the previous one to
+// finish first, and starts filling the other batch.
+static void wb_submit(struct writeback *wb) {
+	struct wb_batch *b = wb->filling;
+	double start = trace_now();
+
+	pthread_mutex_lock(&wb->lock);
+	while (wb->inflight != NULL) {
+		pthread_cond_wait(&wb->cond, &wb->lock);
+	}
+	wb->stall_time += trace_now() - start;
+	wb->inflight = b;
+	pthread_cond_broadcast(&wb->cond);
+	pthread_mutex_unlock(&wb->lock);
+
+	wb->filling = wb->other;
+	wb->other = b;
+	wb->filling->n = 0;
+}
+
+// Returns the queued copy of the page at offset, or NULL
+static char *wb_find(struct writeback *wb, struct wb_batch *b,
+		off_t offset) {
+	unsigned i;
+	for (i = b->n; i-- > 0; ) {
+		if (b->offs[i] == offset) {
+			return b->data + (size_t)i * wb->pagesize;
+		}
+	}
+	return NULL;
+}
+
+static void wb_queue(struct writeback *wb, const char *buf, off_t offset) {
+	struct wb_batch *b = wb->filling;
+	char *dst;
+
+	if ((dst = wb_find(wb, b, offset)) != NULL) {
+		// Rewritten before it left the queue
+		wb->nmerged++;
+	} else {
+		dst = b->data + (size_t)b->n * wb->pagesize;
+		b->offs[b->n++] = offset;
+	}
+	memcpy(dst, buf, wb->pagesize);
+	if (b->n == wb->batch_size) {
+		wb_submit(wb);
+	}
+}
+
+static struct writeback *wb_create(int fd, unsigned batch_size,
+		unsigned pagesize) {
+	struct writeback *wb = calloc(1, sizeof(struct writeback));
+	int i;
+
+	if (wb == NULL) {
+		perror("Failed to allocate writeback queue");
+		exit(1);
+	}
+	wb->batch_size = batch_size;
+	wb->pagesize = pagesize;
+	wb->fd = fd;
+	for (i = 0; i < 2; i++) {
+		wb->batches[i].offs = malloc(batch_size * sizeof(off_t));
+		wb->batches[i].data = malloc((size_t)batch_size * pagesize);
+		if (wb->batches[i].offs == NULL || wb->batches[i].data == NULL) {
+			perror("Failed to allocate writeback queue");
+			exit(1);
+		}
+	}
+	wb->filling = &wb->batches[0];
+	wb->other = &wb->batches[1];
+	pthread_mutex_init(&wb->lock, NULL);
+	pthread_cond_init(&wb->cond, NULL);
+	if (pthread_create(&wb->thread, NULL, wb_writer, wb) != 0) {
+		perror("Failed to start writeback thread");
+		exit(1);
+	}
+	return wb;
+}
+
+// Writes out whatever is still queued and waits until it is written
+static void wb_drain(struct writeback *wb) {
+	if (wb->filling->n > 0) {
+		wb_submit(wb);
+	}
+	pthread_mutex_lock(&wb->lock);
+	while (wb->inflight != NULL) {
+		pthread_cond_wait(&wb->cond, &wb->lock);
+	}
+	pthread_mutex_unlock(&wb->lock);
+}
+
+// Writes out whatever is still queued and stops the writer
+static void wb_destroy(struct writeback *wb) {
+	int i;
+
+	wb_drain(wb);
+	pthread_mutex_lock(&wb->lock);
+	wb->stop = 1;
+	pthread_cond_broadcast(&wb->cond);
+	pthread_mutex_unlock(&wb->lock);
+	pthread_join(wb->thread, NULL);
+
+	pthread_mutex_destroy(&wb->lock);
+	pthread_cond_destroy(&wb->cond);
+	for (i = 0; i < 2; i++) {
+		free(wb->batches[i].offs);
+		free(wb->batches[i].data);
+	}
+	free(wb);
+}
+
+/* Makes dirty evictions in simulations created from now on go through a
+ * writeback queue of batch_size pages, or be written synchronously if
+ * batch_size is 0. Only the file backend supports the queue.
+ */
+void swap_set_writeback(unsigned batch_size) {
+	writeback_batch = batch_size;
+}
+
+/* Selects the backend for simulations created from now on.
+ * Returns 0 on success, or -1 if there is no backend with that name.
+ */
+int swap_set_backend(const char *name) {
+	size_t i;
+	for (i = 0; i < sizeof(swap_backends) / sizeof(swap_backends[0]); i++) {
+		if (strcmp(swap_backends[i].name, name) == 0) {
+			swap_backend = &swap_backends[i];
+			return 0;
+		}
+	}
+	fprintf(stderr, "Error: unknown swap backend %s (file, mmap or ram)\n",
+			name);
+	return -1;
+}
+
+int swap_init(struct sim *s, unsigned swapsize) {
+	struct swap *sw;
+
+	if ((sw = malloc(sizeof(struct swap))) == NULL) {
+		perror("Failed to allocate swap");
 		exit(1);
 	}
 
+	// Initialize the backing store
+	sw->backend = swap_backend;
+	sw->pagesize = s->pagesize;
+	sw->bytes = (size_t)swapsize * sw->pagesize;
+	sw->io_time = 0;
+	sw->io_bytes = 0;
+	if (sw->backend->open(sw, sw->bytes) != 0) {
+		exit(1);
+	}
+
+	sw->wb = NULL;
+	if (writeback_batch > 0) {
+		if (sw->backend != &swap_backends[0]) {
+			fprintf(stderr, "Error: writeback needs the file swap backend\n");
+			exit(1);
+		}
+		sw->wb = wb_create(sw->swapfd, writeback_batch, sw->pagesize);
+	}
+
 	// Initialize the bitmap
-	if ((swapmap = bitmap_create(swapsize)) == NULL) {
+	if ((sw->swapmap = bitmap_create(swapsize)) == NULL) {
 		fprintf(stderr,"Failed to create bitmap for swap\n");
 		exit(1);
 	}
 
+	s->swap = sw;
 	return 0;
 }
 
-void swap_destroy() {
+void swap_destroy(struct sim *s) {
+	struct swap *sw = s->swap;
 
-	// Close and remove swapfile
-	close(swapfd);
-	unlink(fname);
+	// Finish queued writes, then close and remove swapfile, or free swap
+	// memory
+	if (sw->wb != NULL) {
+		wb_destroy(sw->wb);
+	}
+	sw->backend->close(sw, sw->bytes);
 
 	// Destroy bitmap
-	bitmap_destroy(swapmap);
+	bitmap_destroy(sw->swapmap);
+	free(sw);
+	s->swap = NULL;
 	return;
 }
 
+/* Returns the number of seconds this simulation has spent transferring
+ * pages to and from swap.
+ */
+double swap_io_time(struct sim *s) {
+	return s->swap->io_time;
+}
+
+/* Returns the number of bytes this simulation has transferred to and from
+ * swap.
+ */
+unsigned long swap_io_bytes(struct sim *s) {
+	return s->swap->io_bytes;
+}
+
+/* Prints the writeback queue's counters, if the simulation has one. Any
+ * queued pages are written first, so that the counters are final.
+ */
+void swap_print_stats(struct sim *s) {
+	struct writeback *wb = s->swap->wb;
+
+	if (wb == NULL) {
+		return;
+	}
+	wb_drain(wb);
+	printf("Writeback batches: %lu (%.1f pages each, %.1f per pwritev)\n",
+			wb->nbatches,
+			wb->nbatches ? (double)wb->npages / wb->nbatches : 0.0,
+			wb->nwrites ? (double)wb->npages / wb->nwrites : 0.0);
+	printf("Writeback merged writes: %lu, pageins from queue: %lu\n",
+			wb->nmerged, wb->nqueue_hits);
+	printf("Writeback write time: %.6f s, stalled: %.6f s, overlap: %.1f%%\n",
+			wb->write_time, wb->stall_time, wb->write_time > 0 ?
+			100 * (1 - wb->stall_time / wb->write_time) : 0.0);
+}
+
 // Read data into (simulated) physical memory 'frame' from 'swap_offset'
 // in swap file.
 // Input:  frame - the physical frame number (not byte offset) in physmem
@@ -185,31 +659,39 @@ void swap_destroy() {
 // Return: 0 on success, 
 //	   -errno on error or number of bytes read on partial read
 // 
-int swap_pagein(unsigned frame, int swap_offset) {
-	char *frame_ptr;
-	off_t pos;
-	ssize_t bytes_read;
-	
-	assert(swap_offset != INVALID_SWAP);
+int swap_pagein(struct sim *s, unsigned frame, off_t swap_offset) {
+	struct swap *sw = s->swap;
+	char *frame_ptr = &s->physmem[(size_t)frame * sw->pagesize];
+	char *queued;
+	double start;
+	int ret;
 
-	// Get pointer to page data in (simulated) physical memory
-	frame_ptr = &physmem[frame * SIMPAGESIZE];
+	assert(swap_offset != INVALID_SWAP);
 
-	// Seek to position in swap file where this page was stored
-	pos = lseek(swapfd, swap_offset, SEEK_SET);
-	if (pos != swap_offset) {
-		assert(pos == (off_t)-1);
-		perror("swap_pagein: failed to set read position");
-		return -errno;
+	// Read page data from swap into (simulated) physical memory, or from
+	// the writeback queue if it has not reached the file yet
+	start = trace_now();
+	if (sw->wb != NULL &&
+			((queued = wb_find(sw->wb, sw->wb->filling, swap_offset)) != NULL
+			|| (queued = wb_find(sw->wb, sw->wb->other, swap_offset)) != NULL)) {
+		memcpy(frame_ptr, queued, sw->pagesize);
+		sw->wb->nqueue_hits++;
+		ret = 0;
+	} else {
+		ret = sw->backend->read(sw, frame_ptr, swap_offset);
 	}
+	sw->io_time += trace_now() - start;
+	sw->io_bytes += sw->pagesize;
+	return ret;
+}
 
-	// Read page data from swapfile into memory
-	bytes_read = read(swapfd, frame_ptr, SIMPAGESIZE);
-	if (bytes_read != SIMPAGESIZE) {
-		fprintf(stderr,"swap_pagein: did not read whole page\n");
-		return bytes_read;
-	}
-	return 0;
+// Releases the space at 'swap_offset' in the swap file, once the page
+// stored there is no longer needed.
+// Input:  swap_offset - the byte position in the swap file.
+//
+void swap_free(struct sim *s, off_t swap_offset) {
+	assert(swap_offset != INVALID_SWAP);
+	bitmap_unmark(s->swap->swapmap, swap_offset / s->swap->pagesize);
 }
 
 // Write data from (simulated) physical memory 'frame' to 'swap_offset'
@@ -219,37 +701,34 @@ int swap_pagein(unsigned frame, int swap_offset) {
 // Return: the swap_offset where the data was written on success,
 //         or INVALID_SWAP on failure
 // 
-int swap_pageout(unsigned frame, int swap_offset) {
-	char *frame_ptr;
-	off_t pos;
+off_t swap_pageout(struct sim *s, unsigned frame, off_t swap_offset) {
+	struct swap *sw = s->swap;
+	char *frame_ptr = &s->physmem[(size_t)frame * sw->pagesize];
 	unsigned idx;
-	ssize_t bytes_written;
+	double start;
+	int ret;
 
 	// Check if swap has already been allocated for this page 
 	if (swap_offset == INVALID_SWAP) {
-		if (bitmap_alloc(swapmap, &idx) != 0) {
+		if (bitmap_alloc(sw->swapmap, &idx) != 0) {
 			fprintf(stderr,"swap_pageout: Could not allocate space in swapfile. Try running again with a larger swapsize.\n");
 			return INVALID_SWAP;
 		}
-		swap_offset = idx*SIMPAGESIZE;
+		swap_offset = (off_t)idx * sw->pagesize;
 	}
 	assert(swap_offset != INVALID_SWAP);
 
-	// Get pointer to page data in (simulated) physical memory
-	frame_ptr = &physmem[frame * SIMPAGESIZE];
-
-	// Seek to position in swap file where this page will be stored
-	pos = lseek(swapfd, swap_offset, SEEK_SET);
-	if (pos != swap_offset) {
-		assert(pos == (off_t)-1);
-		perror("swap_pageout: failed to set write position");
-		return INVALID_SWAP;
+	// Write page data from (simulated) physical memory to swap
+	start = trace_now();
+	if (sw->wb != NULL) {
+		wb_queue(sw->wb, frame_ptr, swap_offset);
+		ret = 0;
+	} else {
+		ret = sw->backend->write(sw, frame_ptr, swap_offset);
 	}
-
-	// Read page data from swapfile into memory
-	bytes_written = write(swapfd, frame_ptr, SIMPAGESIZE);
-	if (bytes_written != SIMPAGESIZE) {
-		fprintf(stderr,"swap_pageout: did not write whole page\n");
+	sw->io_time += trace_now() - start;
+	sw->io_bytes += sw->pagesize;
+	if (ret != 0) {
 		return INVALID_SWAP;
 	}
 	return swap_offset;
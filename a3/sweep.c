@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "trace.h"
+
+/* Memory size sweep.
+ *
+ * Every (memory size, algorithm) pair is an independent job. A pool of
+ * worker threads takes jobs one at a time, builds a private simulation for
+ * each, and replays the whole trace through it. The decoded trace is shared
+ * read-only by all threads, so the only shared mutable state is the index
+ * of the next job.
+ */
+
+struct sweep_job {
+	unsigned memsize;
+	struct functions *alg;
+
+	// Final counters, copied out of the simulation before it is destroyed
+	unsigned long hit_count;
+	unsigned long miss_count;
+	unsigned long ref_count;
+	unsigned long evict_clean_count;
+	unsigned long evict_dirty_count;
+};
+
+struct sweep {
+	const trace_rec_t *recs;     // Shared, read-only decoded trace
+	size_t nrecs;
+	size_t warmup;               // Leading records not to count
+	size_t window;               // Records to count after those
+	unsigned swapsize;
+
+	struct sweep_job *jobs;
+	int njobs;
+	int next;                    // Next job to hand out, protected by lock
+	pthread_mutex_t lock;
+};
+
+static void *sweep_worker(void *arg) {
+	struct sweep *sw = arg;
+	struct sweep_job *job;
+	struct sim *s;
+
+	for (;;) {
+		pthread_mutex_lock(&sw->lock);
+		job = sw->next < sw->njobs ? &sw->jobs[sw->next++] : NULL;
+		pthread_mutex_unlock(&sw->lock);
+		if (job == NULL) {
+			return NULL;
+		}
+
+		s = sim_create(job->memsize, sw->swapsize, job->alg, sw->recs,
+				sw->nrecs);
+		replay_recs(s, sw->recs, sw->warmup);
+		sim_reset_stats(s);
+		replay_recs(s, sw->recs + sw->warmup, sw->window);
+
+		job->hit_count = s->hit_count;
+		job->miss_count = s->miss_count;
+		job->ref_count = s->ref_count;
+		job->evict_clean_count = s->evict_clean_count;
+		job->evict_dirty_count = s->evict_dirty_count;
+		sim_destroy(s);
+	}
+}
+
+/* Runs every memory size in first..last (inclusive, in steps of step) with
+ * each of the nalgs algorithms, on nthreads threads. Only the window records
+ * after the first warmup are counted; offline algorithms still see all
+ * nrecs. Returns the finished jobs, in memory size order, and sets *njobs.
+ */
+static struct sweep_job *sweep_jobs(const trace_rec_t *recs, size_t nrecs,
+		size_t warmup, size_t window, unsigned swapsize,
+		struct functions **algs, int nalgs, unsigned first, unsigned last,
+		unsigned step, int nthreads, int *njobs) {
+	struct sweep sw;
+	pthread_t *threads;
+	unsigned m;
+	int i, j;
+
+	sw.recs = recs;
+	sw.nrecs = nrecs;
+	sw.warmup = warmup;
+	sw.window = window;
+	sw.swapsize = swapsize;
+	sw.njobs = 0;
+	sw.next = 0;
+	pthread_mutex_init(&sw.lock, NULL);
+
+	sw.jobs = malloc(((last - first) / step + 1) * nalgs *
+			sizeof(struct sweep_job));
+	if (sw.jobs == NULL) {
+		perror("run_sweep: malloc");
+		exit(1);
+	}
+	for (m = first; m >= first && m <= last; m += step) {
+		for (j = 0; j < nalgs; j++) {
+			sw.jobs[sw.njobs].memsize = m;
+			sw.jobs[sw.njobs].alg = algs[j];
+			sw.njobs++;
+		}
+	}
+
+	if (nthreads > sw.njobs) {
+		nthreads = sw.njobs;
+	}
+	threads = malloc(nthreads * sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, sweep_worker, &sw) != 0) {
+			perror("run_sweep: pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&sw.lock);
+	free(threads);
+	*njobs = sw.njobs;
+	return sw.jobs;
+}
+
+/* Runs the sweep described at sweep_jobs() and prints one CSV row per run
+ * in memory size order.
+ */
+void run_sweep(const trace_rec_t *recs, size_t nrecs, size_t warmup,
+		size_t window, unsigned swapsize, struct functions **algs, int nalgs, unsigned first,
+		unsigned last, unsigned step, int nthreads) {
+	struct sweep_job *jobs;
+	int i, njobs;
+
+	jobs = sweep_jobs(recs, nrecs, warmup, window, swapsize, algs, nalgs,
+			first, last, step, nthreads, &njobs);
+
+	printf("algorithm,memsize,references,hits,misses,hit_rate,"
+			"clean_evictions,dirty_evictions\n");
+	for (i = 0; i < njobs; i++) {
+		struct sweep_job *job = &jobs[i];
+		printf("%s,%u,%lu,%lu,%lu,%.4f,%lu,%lu\n", job->alg->name,
+				job->memsize, job->ref_count, job->hit_count,
+				job->miss_count,
+				job->ref_count ?
+				(double)job->hit_count / job->ref_count * 100 : 0.0,
+				job->evict_clean_count, job->evict_dirty_count);
+	}
+	free(jobs);
+}
+
+/* Runs the sweep described at sweep_jobs() with one algorithm, and stores
+ * the miss count at each memory size in misses, in order.
+ */
+void sweep_misses(const trace_rec_t *recs, size_t nrecs, size_t warmup,
+		size_t window, unsigned swapsize, struct functions *alg,
+		unsigned first, unsigned last, unsigned step, int nthreads,
+		unsigned long *misses) {
+	struct sweep_job *jobs;
+	int i, njobs;
+
+	jobs = sweep_jobs(recs, nrecs, warmup, window, swapsize, &alg, 1,
+			first, last, step, nthreads, &njobs);
+	for (i = 0; i < njobs; i++) {
+		misses[i] = jobs[i].miss_count;
+	}
+	free(jobs);
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "tlb.h"
+
+/* Creates an empty TLB with the given number of entries, divided into sets
+ * of ways entries each. The number of sets is rounded down to a power of
+ * two so that the set index is just the low bits of the page number.
+ */
+struct tlb *tlb_create(unsigned entries, unsigned ways) {
+	struct tlb *tlb = calloc(1, sizeof(struct tlb));
+
+	if (tlb == NULL) {
+		perror("Failed to allocate TLB");
+		exit(1);
+	}
+	if (ways == 0 || ways > entries) {
+		ways = entries;
+	}
+	tlb->nsets = 1;
+	while (tlb->nsets * 2 <= entries / ways) {
+		tlb->nsets *= 2;
+	}
+	tlb->ways = ways;
+	tlb->entries = calloc((size_t)tlb->nsets * ways, sizeof(struct tlb_entry));
+	if (tlb->entries == NULL) {
+		perror("Failed to allocate TLB");
+		exit(1);
+	}
+	return tlb;
+}
+
+void tlb_destroy(struct tlb *tlb) {
+	free(tlb->entries);
+	free(tlb);
+}
+
+/* Caches the translation for vpn after a page table walk, replacing an
+ * unused entry of its set if there is one, or else the least recently used.
+ */
+void tlb_insert(struct tlb *tlb, addr_t vpn, pgtbl_entry_t *pte) {
+	struct tlb_entry *set = &tlb->entries[(vpn & (tlb->nsets - 1)) * tlb->ways];
+	struct tlb_entry *victim = &set[0];
+	unsigned i;
+
+	for (i = 0; i < tlb->ways; i++) {
+		if (set[i].pte == NULL) {
+			victim = &set[i];
+			break;
+		}
+		if (set[i].last_use < victim->last_use) {
+			victim = &set[i];
+		}
+	}
+	victim->vpn = vpn;
+	victim->pte = pte;
+	victim->last_use = tlb->clock;
+}
+
+/* Invalidates the translation for vpn, if the TLB holds one, because the
+ * page is being evicted.
+ */
+void tlb_shootdown(struct tlb *tlb, addr_t vpn) {
+	struct tlb_entry *set = &tlb->entries[(vpn & (tlb->nsets - 1)) * tlb->ways];
+	unsigned i;
+
+	for (i = 0; i < tlb->ways; i++) {
+		if (set[i].vpn == vpn && set[i].pte != NULL) {
+			set[i].pte = NULL;
+			tlb->shootdowns++;
+			return;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef __TLB_H__
+#define __TLB_H__
+
+#include "pagetable.h"
+
+/* A simulated set-associative TLB.
+ *
+ * It caches translations from virtual page numbers to the page table
+ * entries of resident pages, so that find_physpage() can skip the page
+ * table walk on a hit. Each set is a few entries replaced in LRU order.
+ * When a page is evicted its translation must be shot down, since the
+ * entry would otherwise point at a page that is no longer in memory.
+ */
+struct tlb_entry {
+	addr_t vpn;
+	pgtbl_entry_t *pte;          // NULL if the entry is unused
+	unsigned long last_use;      // For LRU replacement within the set
+};
+
+struct tlb {
+	unsigned nsets;              // A power of two
+	unsigned ways;
+	struct tlb_entry *entries;   // Set i is entries[i * ways ...]
+	unsigned long clock;         // Lookups so far, stamps last_use
+
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long shootdowns;    // Entries invalidated by evictions
+};
+
+extern struct tlb *tlb_create(unsigned entries, unsigned ways);
+extern void tlb_destroy(struct tlb *tlb);
+extern void tlb_insert(struct tlb *tlb, addr_t vpn, pgtbl_entry_t *pte);
+extern void tlb_shootdown(struct tlb *tlb, addr_t vpn);
+
+/* Returns the cached page table entry for vpn, or NULL on a TLB miss.
+ */
+static inline pgtbl_entry_t *tlb_lookup(struct tlb *tlb, addr_t vpn) {
+	struct tlb_entry *set = &tlb->entries[(vpn & (tlb->nsets - 1)) * tlb->ways];
+	unsigned i;
+
+	tlb->clock++;
+	for (i = 0; i < tlb->ways; i++) {
+		if (set[i].vpn == vpn && set[i].pte != NULL) {
+			set[i].last_use = tlb->clock;
+			tlb->hits++;
+			return set[i].pte;
+		}
+	}
+	tlb->misses++;
+	return NULL;
+}
+
+#endif /* __TLB_H__ */
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "trace.h"
+#include "inst.h"
+
+/* Returns a monotonic timestamp in seconds, used to time trace replay.
+ */
+double trace_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Parses one line of a text trace ("<type> <hex vaddr> [<pid>]") into type,
+ * vaddr and pid, which is -1 if the line has none.
+ * This replaces sscanf("%c %lx"), which dominates replay time on large
+ * traces.
+ * Returns 1 if the line holds a reference, or 0 if it should be skipped
+ * (valgrind header lines starting with '=' and empty lines).
+ */
+int trace_parse_line(const char *buf, char *type, addr_t *vaddr, long *pid) {
+	const char *p = buf;
+	addr_t v = 0;
+	long n = -1;
+
+	if (*p == '=' || *p == '\n' || *p == '\0') {
+		return 0;
+	}
+	*type = *p++;
+
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	for (;;) {
+		char c = *p++;
+		if (c >= '0' && c <= '9') {
+			v = (v << 4) | (addr_t)(c - '0');
+		} else if (c >= 'a' && c <= 'f') {
+			v = (v << 4) | (addr_t)(c - 'a' + 10);
+		} else if (c >= 'A' && c <= 'F') {
+			v = (v << 4) | (addr_t)(c - 'A' + 10);
+		} else {
+			p--;
+			break;
+		}
+	}
+	*vaddr = v;
+
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	if (*p >= '0' && *p <= '9') {
+		for (n = 0; *p >= '0' && *p <= '9'; p++) {
+			n = n * 10 + (*p - '0');
+		}
+	}
+	*pid = n;
+	return 1;
+}
+
+/* Returns the ASID for pid, numbering processes in the order they first
+ * appear in the trace.
+ */
+unsigned trace_asid(struct trace_reader *tr, unsigned pid) {
+	unsigned i;
+
+	// References come in runs from one process, so check the last first
+	if (tr->nasids > 0 && tr->pids[tr->nasids - 1] == pid) {
+		return tr->nasids - 1;
+	}
+	for (i = 0; i < tr->nasids; i++) {
+		if (tr->pids[i] == pid) {
+			return i;
+		}
+	}
+	if (tr->nasids == MAX_ASIDS) {
+		fprintf(stderr, "Error: the trace has more than %d processes\n",
+				MAX_ASIDS);
+		exit(1);
+	}
+	tr->pids[tr->nasids] = pid;
+	return tr->nasids++;
+}
+
+/* Decodes one line of a text trace into rec, tagging its address with the
+ * ASID of its process if it names one.
+ * Returns 1 if the line holds a reference, or 0 if it should be skipped.
+ */
+int trace_decode_line(struct trace_reader *tr, const char *line,
+		trace_rec_t *rec) {
+	char type;
+	addr_t vaddr;
+	long pid;
+
+	if (!trace_parse_line(line, &type, &vaddr, &pid)) {
+		return 0;
+	}
+	if (pid >= 0) {
+		vaddr = VADDR_ADDR(vaddr) |
+			((addr_t)trace_asid(tr, pid) << ASID_SHIFT);
+	}
+	*rec = TREC_MAKE(type, vaddr);
+	return 1;
+}
+
+/* Maps a binary trace into memory. Returns 0 on success, or -1 if the file
+ * is not a valid binary trace.
+ */
+static int trace_map(struct trace_reader *tr, int fd, const char *path) {
+	struct stat st;
+	struct trace_header *hdr;
+
+	if (fstat(fd, &st) == -1) {
+		perror("trace_map: fstat");
+		return -1;
+	}
+	tr->maplen = st.st_size;
+	tr->map = mmap(NULL, tr->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (tr->map == MAP_FAILED) {
+		perror("trace_map: mmap");
+		return -1;
+	}
+	// Check that the header fits before reading it, and compare nrecs by
+	// division, so that a corrupt count cannot overflow past the check
+	hdr = (struct trace_header *)tr->map;
+	if (tr->maplen < sizeof(*hdr) || hdr->version != TRACE_VERSION ||
+	    hdr->nrecs > (tr->maplen - sizeof(*hdr)) / sizeof(trace_rec_t)) {
+		fprintf(stderr, "trace_map: %s is truncated or has an unknown version\n",
+				path);
+		munmap(tr->map, tr->maplen);
+		return -1;
+	}
+	// Records are only read front to back, so tell the kernel to read ahead
+	madvise(tr->map, tr->maplen, MADV_SEQUENTIAL);
+
+	tr->recs = (const trace_rec_t *)(hdr + 1);
+	tr->nrecs = hdr->nrecs;
+	if (hdr->flags & TRACE_FLAG_PIDS) {
+		const uint32_t *table = (const uint32_t *)(tr->recs + tr->nrecs);
+		size_t end = (const char *)(table + 1) - (const char *)tr->map;
+		if (end > tr->maplen || table[0] > MAX_ASIDS ||
+		    end + table[0] * sizeof(uint32_t) > tr->maplen) {
+			fprintf(stderr, "trace_map: %s has a bad pid table\n", path);
+			munmap(tr->map, tr->maplen);
+			return -1;
+		}
+		tr->nasids = table[0];
+		memcpy(tr->pids, table + 1, tr->nasids * sizeof(uint32_t));
+	}
+	tr->pos = 0;
+	tr->binary = 1;
+	return 0;
+}
+
+/* Opens a trace for replay. Binary traces (recognised by TRACE_MAGIC) are
+ * mmapped; gzip and zstd compressed traces of either kind are decompressed
+ * on a separate thread as they are replayed; anything else is read as a
+ * text trace. A NULL path reads a text trace from stdin, which cannot be
+ * mapped or reopened, so a binary or compressed one there is an error.
+ * Returns 0 on success, -1 on error.
+ */
+int trace_open(struct trace_reader *tr, const char *path) {
+	char magic[TRACE_MAGIC_LEN];
+	size_t got = 0;
+
+	memset(tr, 0, sizeof(*tr));
+	if (path == NULL) {
+		tr->fp = stdin;
+	} else if ((tr->fp = fopen(path, "r")) == NULL) {
+		perror("Error opening tracefile");
+		return -1;
+	}
+
+	got = fread(magic, 1, TRACE_MAGIC_LEN, tr->fp);
+	if (path == NULL) {
+		if ((got == TRACE_MAGIC_LEN &&
+		     memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) ||
+		    (got >= 2 && memcmp(magic, GZIP_MAGIC, 2) == 0) ||
+		    (got >= 4 && memcmp(magic, ZSTD_MAGIC, 4) == 0)) {
+			fprintf(stderr, "Error: binary and compressed traces must be given with -f, not on stdin\n");
+			return -1;
+		}
+		// The bytes read are the start of a text trace
+		memcpy(tr->pending, magic, got);
+		tr->npending = got;
+	}
+	if (got == TRACE_MAGIC_LEN &&
+	    memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		int ret = trace_map(tr, fileno(tr->fp), path);
+		fclose(tr->fp);
+		tr->fp = NULL;
+		return ret;
+	}
+	if ((got >= 2 && memcmp(magic, GZIP_MAGIC, 2) == 0) ||
+			(got >= 4 && memcmp(magic, ZSTD_MAGIC, 4) == 0)) {
+		fclose(tr->fp);
+		tr->fp = NULL;
+		return trace_stream_open(tr, path, magic[0] != GZIP_MAGIC[0]);
+	}
+	if (path != NULL) {
+		rewind(tr->fp);
+	}
+
+	if ((tr->buf = malloc(TRACE_BATCH * sizeof(trace_rec_t))) == NULL) {
+		perror("trace_open: malloc");
+		return -1;
+	}
+	return 0;
+}
+
+// Reads the next line of a text trace like fgets(), starting with any
+// bytes trace_open() read from stdin to look for a magic
+static char *trace_gets(struct trace_reader *tr, char *line) {
+	size_t len = 0;
+
+	while (tr->npending > 0) {
+		tr->npending--;
+		if ((line[len++] = tr->pending[tr->pending_pos++]) == '\n') {
+			break;
+		}
+	}
+	if (len == 0) {
+		return fgets(line, MAXLINE, tr->fp);
+	}
+	line[len] = '\0';
+	if (line[len - 1] != '\n') {
+		// The line goes on past the pending bytes
+		if (fgets(line + len, MAXLINE - len, tr->fp) == NULL) {
+			line[len] = '\0';
+		}
+	}
+	return line;
+}
+
+/* Sets *recs to the next batch of records in the trace.
+ * Returns the number of records in the batch, or 0 at the end of the trace.
+ */
+size_t trace_next(struct trace_reader *tr, const trace_rec_t **recs) {
+	char line[MAXLINE];
+	size_t n = 0;
+	double start = trace_now();
+	uint64_t cycles = inst_now();
+
+	if (tr->recs != NULL) {
+		n = tr->nrecs - tr->pos;
+		*recs = tr->recs + tr->pos;
+		tr->pos = tr->nrecs;
+	} else if (tr->stream != NULL) {
+		n = trace_stream_next(tr->stream, recs);
+	} else {
+		while (n < TRACE_BATCH && trace_gets(tr, line) != NULL) {
+			n += trace_decode_line(tr, line, &tr->buf[n]);
+		}
+		*recs = tr->buf;
+	}
+
+	tr->decode_cycles += inst_now() - cycles;
+	tr->decode_time += trace_now() - start;
+	return n;
+}
+
+/* Makes the whole trace available in tr->recs, so that it can be shared
+ * read-only by several simulations that each walk it at their own pace.
+ * Binary traces are already mapped; text traces are decoded into memory.
+ * Returns 0 on success, -1 on error.
+ */
+int trace_load(struct trace_reader *tr) {
+	const trace_rec_t *recs;
+	size_t n, cap = TRACE_BATCH;
+	trace_rec_t *all;
+
+	if (tr->recs != NULL) {
+		return 0;
+	}
+	if ((all = malloc(cap * sizeof(trace_rec_t))) == NULL) {
+		perror("trace_load: malloc");
+		return -1;
+	}
+	while ((n = trace_next(tr, &recs)) > 0) {
+		if (tr->nrecs + n > cap) {
+			trace_rec_t *bigger;
+			cap *= 2;
+			if ((bigger = realloc(all, cap * sizeof(trace_rec_t))) == NULL) {
+				perror("trace_load: realloc");
+				free(all);
+				return -1;
+			}
+			all = bigger;
+		}
+		memcpy(all + tr->nrecs, recs, n * sizeof(trace_rec_t));
+		tr->nrecs += n;
+	}
+
+	// The decode buffer is no longer needed; keep the whole trace instead.
+	free(tr->buf);
+	tr->buf = all;
+	tr->recs = all;
+	tr->pos = 0;
+	return 0;
+}
+
+/* Bounds the replay of the trace by the stores to the markers whose
+ * addresses are in the marker file at path, as written by the programs in
+ * traceprogs ("<MARKER_START> <MARKER_END>"). The trace must keep those
+ * stores exactly, as fastslim -M does.
+ * Returns 0 on success, -1 on error.
+ */
+int trace_set_markers(struct trace_reader *tr, const char *path) {
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL) {
+		perror("Error opening marker file");
+		return -1;
+	}
+	if (fscanf(fp, "%lx %lx", &tr->marker_start, &tr->marker_end) != 2) {
+		fprintf(stderr, "Error: %s does not hold two marker addresses\n",
+				path);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	tr->windowed = 1;
+	tr->phase = WINDOW_WARMUP;
+	return 0;
+}
+
+/* Splits a batch of n records at the marker stores, as a filter between
+ * trace_next() and the replay. Returns how many records at the front of
+ * recs belong to one phase, and sets *phase to it. The store to
+ * MARKER_START is the last warm-up reference; the store to MARKER_END is
+ * not replayed. Without markers, every record is in WINDOW_MEASURE.
+ */
+size_t trace_window(struct trace_reader *tr, const trace_rec_t *recs,
+		size_t n, int *phase) {
+	size_t i;
+
+	*phase = tr->windowed ? tr->phase : WINDOW_MEASURE;
+	if (!tr->windowed || *phase == WINDOW_DONE) {
+		return n;
+	}
+	for (i = 0; i < n; i++) {
+		char type = TREC_TYPE(recs[i]);
+		addr_t vaddr = VADDR_ADDR(TREC_VADDR(recs[i]));
+
+		if (type != 'S' && type != 'M') {
+			continue;
+		}
+		if (*phase == WINDOW_WARMUP && vaddr == tr->marker_start) {
+			tr->phase = WINDOW_MEASURE;
+			tr->warmup += i + 1;
+			return i + 1;
+		}
+		if (*phase == WINDOW_MEASURE && vaddr == tr->marker_end) {
+			tr->phase = WINDOW_DONE;
+			return i;
+		}
+	}
+	if (*phase == WINDOW_WARMUP) {
+		tr->warmup += n;
+	}
+	return n;
+}
+
+void trace_close(struct trace_reader *tr) {
+	if (tr->binary) {
+		munmap(tr->map, tr->maplen);
+	} else {
+		if (tr->stream != NULL) {
+			trace_stream_close(tr->stream);
+		}
+		if (tr->fp != NULL && tr->fp != stdin) {
+			fclose(tr->fp);
+		}
+		free(tr->buf);
+	}
+	memset(tr, 0, sizeof(*tr));
+}
@@ -0,0 +1,116 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "pagetable.h"
+
+/* Binary trace format.
+ *
+ * A binary trace is a fixed-size header followed by an array of 64-bit
+ * records, one per memory reference. Each record holds the reference type
+ * character ('I', 'L', 'S' or 'M') in its top byte and the virtual address
+ * in the low 56 bits. Fixed-width records let the simulator mmap the file
+ * and replay it directly, without any per-line parsing.
+ *
+ * Traces of several processes tag each address with the ASID (address
+ * space ID) of its process in bits 48-55 (see VADDR_ASID), leaving 48
+ * bits for the address itself. ASIDs are numbered from 0 in the order the
+ * processes first appear. If TRACE_FLAG_PIDS is set, the records are
+ * followed by a uint32_t count and then the pid of each ASID.
+ */
+#define TRACE_MAGIC        "SIMTRACE"
+#define TRACE_MAGIC_LEN    8
+#define TRACE_VERSION      1
+#define TRACE_FLAG_PIDS    0x1
+
+// Leading bytes of the compressed files trace_open() recognises
+#define GZIP_MAGIC         "\x1f\x8b"
+#define ZSTD_MAGIC         "\x28\xb5\x2f\xfd"
+
+#define TREC_TYPE_SHIFT    56
+#define TREC_VADDR_MASK    ((((uint64_t)1) << TREC_TYPE_SHIFT) - 1)
+
+#define TREC_MAKE(type, vaddr) \
+	(((uint64_t)(unsigned char)(type) << TREC_TYPE_SHIFT) | \
+	 ((uint64_t)(vaddr) & TREC_VADDR_MASK))
+#define TREC_TYPE(r)       ((char)((r) >> TREC_TYPE_SHIFT))
+#define TREC_VADDR(r)      ((addr_t)((r) & TREC_VADDR_MASK))
+
+typedef uint64_t trace_rec_t;
+
+struct trace_stream;
+
+struct trace_header {
+	char magic[TRACE_MAGIC_LEN];  // TRACE_MAGIC, not NUL terminated
+	uint32_t version;             // TRACE_VERSION
+	uint32_t flags;               // TRACE_FLAG_PIDS, or 0
+	uint64_t nrecs;               // Number of records following the header
+};
+
+// Number of records decoded from a text trace per call to trace_next()
+#define TRACE_BATCH 4096
+
+/* Phases of a trace bounded by the stores to a traced program's markers
+ * (see trace_window()). References before the first store to MARKER_START
+ * warm up the simulation but are not counted, and the replay stops at the
+ * store to MARKER_END.
+ */
+#define WINDOW_WARMUP      0
+#define WINDOW_MEASURE     1
+#define WINDOW_DONE        2
+
+/* A trace reader hands out records in batches, regardless of whether the
+ * underlying file is a text trace (parsed into buf) or a binary trace
+ * (mmapped, so batches point straight into the mapping).
+ */
+struct trace_reader {
+	int binary;                 // True if reading a mmapped binary trace
+	FILE *fp;                   // Text input stream
+	char pending[TRACE_MAGIC_LEN]; // Bytes read from stdin to look for a
+	unsigned npending;          // magic, not yet parsed, from pending_pos
+	unsigned pending_pos;
+	trace_rec_t *buf;           // Decode buffer for text input
+	void *map;                  // Start of mapping for binary input
+	size_t maplen;              // Length of mapping in bytes
+	const trace_rec_t *recs;    // The whole trace, once mapped or loaded
+	size_t nrecs;               // Number of records in recs
+	size_t pos;                 // Next record to hand out from recs
+	double decode_time;         // Seconds spent inside trace_next()
+	uint64_t decode_cycles;     // The same, in inst_now() cycles
+	struct trace_stream *stream; // Decoder of a compressed trace, or NULL
+	uint32_t pids[MAX_ASIDS];   // pids[asid] = process the ASID stands for
+	unsigned nasids;            // Number of ASIDs, or 0 if the trace is of
+	                            // one untagged process
+
+	int windowed;               // True if marker_start/end bound the trace
+	addr_t marker_start;        // Addresses of MARKER_START and MARKER_END
+	addr_t marker_end;
+	int phase;                  // WINDOW_*, for the next record
+	unsigned long warmup;       // References handed out before the window
+};
+
+extern int trace_parse_line(const char *buf, char *type, addr_t *vaddr,
+		long *pid);
+extern unsigned trace_asid(struct trace_reader *tr, unsigned pid);
+extern int trace_decode_line(struct trace_reader *tr, const char *line,
+		trace_rec_t *rec);
+
+extern int trace_stream_open(struct trace_reader *tr, const char *path,
+		int zstd);
+extern size_t trace_stream_next(struct trace_stream *st,
+		const trace_rec_t **recs);
+extern void trace_stream_close(struct trace_stream *st);
+
+extern int trace_open(struct trace_reader *tr, const char *path);
+extern size_t trace_next(struct trace_reader *tr, const trace_rec_t **recs);
+extern int trace_load(struct trace_reader *tr);
+extern int trace_set_markers(struct trace_reader *tr, const char *path);
+extern size_t trace_window(struct trace_reader *tr, const trace_rec_t *recs,
+		size_t n, int *phase);
+extern void trace_close(struct trace_reader *tr);
+
+extern double trace_now(void);
+
+#endif /* __TRACE_H__ */
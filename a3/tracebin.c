@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace.h"
+
+/* Converts a text trace (as produced by traceprogs/fastslim) into the binary trace
+ * format described in trace.h, so that sim can mmap it and replay it without
+ * parsing. The pids of a multi-process trace are kept in a table after the
+ * records.
+ *
+ * USAGE: tracebin [-f tracefile] -o outfile
+ * Reads the text trace from stdin if no tracefile is given.
+ */
+int main(int argc, char *argv[]) {
+	int opt;
+	char *tracefile = NULL;
+	char *outfile = NULL;
+	char *usage = "USAGE: tracebin [-f tracefile] -o outfile\n";
+	struct trace_reader tr;
+	struct trace_header hdr;
+	const trace_rec_t *recs;
+	size_t n;
+	FILE *outfp;
+	double start;
+
+	while ((opt = getopt(argc, argv, "f:o:")) != -1) {
+		switch (opt) {
+		case 'f':
+			tracefile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (outfile == NULL) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+
+	if (trace_open(&tr, tracefile) != 0) {
+		exit(1);
+	}
+	if ((outfp = fopen(outfile, "w")) == NULL) {
+		perror("Error opening outfile");
+		exit(1);
+	}
+
+	// Write a placeholder header and fill in the record count at the end
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	hdr.version = TRACE_VERSION;
+	if (fwrite(&hdr, sizeof(hdr), 1, outfp) != 1) {
+		perror("Error writing outfile");
+		exit(1);
+	}
+
+	start = trace_now();
+	while ((n = trace_next(&tr, &recs)) > 0) {
+		if (fwrite(recs, sizeof(trace_rec_t), n, outfp) != n) {
+			perror("Error writing outfile");
+			exit(1);
+		}
+		hdr.nrecs += n;
+	}
+	if (tr.nasids > 0) {
+		uint32_t count = tr.nasids;
+		if (fwrite(&count, sizeof(count), 1, outfp) != 1 ||
+				fwrite(tr.pids, sizeof(uint32_t), count, outfp) != count) {
+			perror("Error writing outfile");
+			exit(1);
+		}
+		hdr.flags |= TRACE_FLAG_PIDS;
+	}
+
+	rewind(outfp);
+	if (fwrite(&hdr, sizeof(hdr), 1, outfp) != 1 || fclose(outfp) != 0) {
+		perror("Error writing outfile");
+		exit(1);
+	}
+	trace_close(&tr);
+
+	fprintf(stderr, "Converted %lu references in %.3f s\n",
+			(unsigned long)hdr.nrecs, trace_now() - start);
+	return 0;
+}
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include "trace.h"
+
+/* Generates synthetic traces, so that sim can be benchmarked on workloads
+ * far larger than the bundled ones, and every run of a benchmark sees the
+ * same references.
+ *
+ * The trace is a sequence of phases, each given an equal share of the
+ * references. A phase is one pattern, or several joined by '+', in which
+ * case each reference comes from one of them at random:
+ *
+ *   zipf[:alpha]   pages of a hot set of footprint pages, the k-th most
+ *                  popular chosen with probability proportional to
+ *                  1/k^alpha (alpha defaults to 0.99)
+ *   scan           a sequential walk over fresh pages that are never
+ *                  referenced again
+ *   loop[:pages]   a cyclic walk over pages pages (default footprint),
+ *                  which LRU loses entirely once it exceeds memory
+ *   stride         C = A * B on three square matrices of doubles filling
+ *                  footprint pages, in i, j, k order, so B is walked
+ *                  column by column
+ *
+ * Every pattern of every phase has its own region of the address space, so
+ * a phase change moves the whole working set. Each reference is a store
+ * with probability write_ratio and a load otherwise; addresses are page
+ * aligned, as in reduced traces.
+ *
+ * USAGE: tracegen -n length [-F footprint] [-w write_ratio] [-S seed]
+ *                 [-p phase[,phase...]] [-B] [-o outfile]
+ * Writes a text trace to stdout unless there is an outfile; -B writes the
+ * binary format of trace.h instead. The length may end in K, M or G, for
+ * thousands, millions or billions of references.
+ */
+#define MAX_PARTS   4          // Patterns joined by '+' in one phase
+#define OUTBUF      (1 << 16)  // Bytes of output written at a time
+
+enum pattern { ZIPF, SCAN, LOOP, STRIDE };
+
+struct part {
+	enum pattern pattern;
+	addr_t base;               // First page of its region
+	uint64_t pages;            // Pages in the region
+
+	// zipf: Vose's alias table over popularity ranks, so each draw is
+	// O(1), and a multiplier that scatters ranks over the region
+	double alpha;
+	double *prob;
+	uint32_t *alias;
+	uint64_t scatter;
+
+	uint64_t pos;              // scan and loop: next page
+	uint64_t n, i, j, k, op;   // stride: matrix side, loop indices, and
+	                           // which of A, B, C is next
+};
+
+struct phase {
+	struct part parts[MAX_PARTS];
+	int nparts;
+	uint64_t length;           // References in the phase
+};
+
+static uint64_t rng_state;
+
+// splitmix64: fast, seedable, and good enough for workload generation
+static uint64_t rng_next(void) {
+	uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// A uniform double in [0, 1)
+static double rng_double(void) {
+	return (rng_next() >> 11) * (1.0 / (1ULL << 53));
+}
+
+// A uniform integer in [0, n)
+static uint64_t rng_below(uint64_t n) {
+	return (uint64_t)(((unsigned __int128)rng_next() * n) >> 64);
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+	while (b != 0) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Builds the alias table for ranks 1..pages with weights 1/k^alpha
+static void zipf_init(struct part *p) {
+	uint64_t n = p->pages, i, nsmall = 0, nlarge = 0;
+	uint32_t *small = malloc(n * sizeof(uint32_t));
+	uint32_t *large = malloc(n * sizeof(uint32_t));
+	double sum = 0;
+
+	p->prob = malloc(n * sizeof(double));
+	p->alias = malloc(n * sizeof(uint32_t));
+	if (small == NULL || large == NULL || p->prob == NULL ||
+			p->alias == NULL) {
+		perror("tracegen: malloc");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		p->prob[i] = pow(i + 1, -p->alpha);
+		sum += p->prob[i];
+	}
+	for (i = 0; i < n; i++) {
+		p->prob[i] *= n / sum;
+		if (p->prob[i] < 1.0) {
+			small[nsmall++] = i;
+		} else {
+			large[nlarge++] = i;
+		}
+	}
+	while (nsmall > 0 && nlarge > 0) {
+		uint32_t s = small[--nsmall], l = large[--nlarge];
+		p->alias[s] = l;
+		p->prob[l] -= 1.0 - p->prob[s];
+		if (p->prob[l] < 1.0) {
+			small[nsmall++] = l;
+		} else {
+			large[nlarge++] = l;
+		}
+	}
+	while (nlarge > 0) {
+		p->prob[large[--nlarge]] = 1.0;
+	}
+	while (nsmall > 0) {
+		p->prob[small[--nsmall]] = 1.0;
+	}
+	free(small);
+	free(large);
+
+	// Popular pages should not all be neighbours, so rank r goes to page
+	// r * scatter mod pages, which is a permutation since they are coprime
+	for (p->scatter = 2654435761ULL % n; n > 1 && (p->scatter == 0 ||
+			gcd(p->scatter, n) != 1); p->scatter++) {
+	}
+	if (n == 1) {
+		p->scatter = 1;
+	}
+}
+
+// Returns the page of the next reference from p
+static addr_t part_next(struct part *p) {
+	uint64_t page, r;
+
+	switch (p->pattern) {
+	case ZIPF:
+		r = rng_below(p->pages);
+		if (rng_double() >= p->prob[r]) {
+			r = p->alias[r];
+		}
+		page = (uint64_t)(((unsigned __int128)r * p->scatter) % p->pages);
+		break;
+	case SCAN:
+		page = p->pos++;
+		break;
+	case LOOP:
+		page = p->pos;
+		p->pos = (p->pos + 1 == p->pages) ? 0 : p->pos + 1;
+		break;
+	case STRIDE:
+	default:
+		// Element offsets of A[i][k], B[k][j] and C[i][j], each matrix
+		// n * n doubles after the one before
+		if (p->op == 0) {
+			r = p->i * p->n + p->k;
+		} else if (p->op == 1) {
+			r = p->n * p->n + p->k * p->n + p->j;
+		} else {
+			r = 2 * p->n * p->n + p->i * p->n + p->j;
+		}
+		page = r * sizeof(double) >> PAGE_SHIFT;
+		if (++p->op == 3) {
+			p->op = 0;
+			if (++p->k == p->n) {
+				p->k = 0;
+				if (++p->j == p->n) {
+					p->j = 0;
+					p->i = (p->i + 1) % p->n;
+				}
+			}
+		}
+		break;
+	}
+	return p->base + page;
+}
+
+// Parses a count, optionally followed by K, M or G (powers of 1000)
+static int parse_count(const char *arg, uint64_t *count) {
+	char *end;
+	uint64_t n, scale = 1;
+
+	errno = 0;
+	n = strtoull(arg, &end, 10);
+	if (!isdigit((unsigned char)arg[0]) || errno == ERANGE) {
+		return -1;
+	}
+	switch (*end) {
+	case 'K': case 'k': scale = 1000; end++; break;
+	case 'M': case 'm': scale = 1000000; end++; break;
+	case 'G': case 'g': scale = 1000000000; end++; break;
+	}
+	if (*end != '\0' || n == 0 || n > UINT64_MAX / scale) {
+		return -1;
+	}
+	*count = n * scale;
+	return 0;
+}
+
+// Parses one pattern of a phase into p. Returns 0 on success.
+static int parse_part(char *spec, struct part *p, uint64_t footprint) {
+	char *arg = strchr(spec, ':');
+
+	if (arg != NULL) {
+		*arg++ = '\0';
+	}
+	memset(p, 0, sizeof(*p));
+	p->pages = footprint;
+	if (strcmp(spec, "zipf") == 0) {
+		p->pattern = ZIPF;
+		p->alpha = 0.99;
+		if (arg != NULL) {
+			char *end;
+			p->alpha = strtod(arg, &end);
+			if (end == arg || *end != '\0') {
+				return -1;
+			}
+		}
+		return p->alpha > 0 ? 0 : -1;
+	} else if (strcmp(spec, "scan") == 0) {
+		p->pattern = SCAN;
+		return arg == NULL ? 0 : -1;
+	} else if (strcmp(spec, "loop") == 0) {
+		p->pattern = LOOP;
+		return (arg == NULL || parse_count(arg, &p->pages) == 0) ? 0 : -1;
+	} else if (strcmp(spec, "stride") == 0) {
+		p->pattern = STRIDE;
+		p->n = (uint64_t)sqrt((double)footprint / 3 *
+				(PAGE_SIZE / sizeof(double)));
+		return (arg == NULL && p->n > 0) ? 0 : -1;
+	}
+	return -1;
+}
+
+// Appends a reference to the output, writing it out when the buffer fills
+static void emit(FILE *fp, char *buf, size_t *len, int binary, char type,
+		addr_t vaddr) {
+	if (binary) {
+		trace_rec_t rec = TREC_MAKE(type, vaddr);
+		memcpy(buf + *len, &rec, sizeof(rec));
+		*len += sizeof(rec);
+	} else {
+		*len += sprintf(buf + *len, "%c %lx\n", type, vaddr);
+	}
+	if (*len >= OUTBUF) {
+		if (fwrite(buf, 1, *len, fp) != *len) {
+			perror("Error writing outfile");
+			exit(1);
+		}
+		*len = 0;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	char *outfile = NULL;
+	char *spec = "zipf";
+	char *usage = "USAGE: tracegen -n length [-F footprint] [-w write_ratio] [-S seed] [-p phase[,phase...]] [-B] [-o outfile]\n"
+			"  patterns: zipf[:alpha] scan loop[:pages] stride, joined by '+' within a phase\n";
+	uint64_t length = 0, footprint = 10000, seed = 1, i;
+	double write_ratio = 0.3, start;
+	int binary = 0, nphases = 1, ph, j;
+	struct phase *phases;
+	addr_t next_base = 0;
+	char *phase_spec, *part_spec, *save1, *save2, *c, *end;
+	char outbuf[OUTBUF + 64];
+	size_t outlen = 0;
+	struct trace_header hdr;
+	FILE *outfp = stdout;
+
+	while ((opt = getopt(argc, argv, "n:F:w:S:p:Bo:")) != -1) {
+		switch (opt) {
+		case 'n':
+			if (parse_count(optarg, &length) != 0) {
+				fprintf(stderr, "%s", usage);
+				exit(1);
+			}
+			break;
+		case 'F':
+			if (parse_count(optarg, &footprint) != 0) {
+				fprintf(stderr, "%s", usage);
+				exit(1);
+			}
+			// The zipf alias table holds 32-bit ranks
+			if (footprint > UINT32_MAX) {
+				fprintf(stderr, "Error: the footprint is at most %u pages\n",
+						UINT32_MAX);
+				exit(1);
+			}
+			break;
+		case 'w':
+			write_ratio = strtod(optarg, &end);
+			if (end == optarg || *end != '\0' || !(write_ratio >= 0 &&
+					write_ratio <= 1)) {
+				fprintf(stderr, "Error: the write ratio must be from 0 to 1\n");
+				exit(1);
+			}
+			break;
+		case 'S':
+			errno = 0;
+			seed = strtoull(optarg, &end, 10);
+			if (!isdigit((unsigned char)optarg[0]) || *end != '\0' ||
+					errno == ERANGE) {
+				fprintf(stderr, "Error: the seed must be a number\n");
+				exit(1);
+			}
+			break;
+		case 'p':
+			spec = optarg;
+			break;
+		case 'B':
+			binary = 1;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (length == 0) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+	rng_state = seed;
+
+	// Lay out the phases, each pattern in a region of its own. A scan
+	// never comes back, so its region is as long as its share of the
+	// phase could be.
+	for (c = spec; *c != '\0'; c++) {
+		nphases += (*c == ',');
+	}
+	if ((phases = calloc(nphases, sizeof(struct phase))) == NULL ||
+			(spec = strdup(spec)) == NULL) {
+		perror("tracegen: malloc");
+		exit(1);
+	}
+	ph = 0;
+	for (phase_spec = strtok_r(spec, ",", &save1); phase_spec != NULL;
+			phase_spec = strtok_r(NULL, ",", &save1), ph++) {
+		struct phase *phase = &phases[ph];
+		phase->length = length / nphases + ((uint64_t)ph < length % nphases);
+		for (part_spec = strtok_r(phase_spec, "+", &save2); part_spec != NULL;
+				part_spec = strtok_r(NULL, "+", &save2)) {
+			struct part *p = &phase->parts[phase->nparts];
+			if (phase->nparts == MAX_PARTS ||
+					parse_part(part_spec, p, footprint) != 0) {
+				fprintf(stderr, "Error: bad phase - %s\n%s", part_spec, usage);
+				exit(1);
+			}
+			if (p->pattern == SCAN) {
+				p->pages = phase->length;
+			} else if (p->pattern == ZIPF) {
+				zipf_init(p);
+			}
+			p->base = next_base;
+			next_base += p->pages;
+			phase->nparts++;
+		}
+	}
+	free(spec);
+	if (nphases != ph) {
+		fprintf(stderr, "Error: empty phase\n%s", usage);
+		exit(1);
+	}
+
+	if (outfile != NULL && (outfp = fopen(outfile, "w")) == NULL) {
+		perror("Error opening outfile");
+		exit(1);
+	}
+	if (binary) {
+		// The length is known, so the header can go out first
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+		hdr.version = TRACE_VERSION;
+		hdr.nrecs = length;
+		if (fwrite(&hdr, sizeof(hdr), 1, outfp) != 1) {
+			perror("Error writing outfile");
+			exit(1);
+		}
+	}
+
+	start = trace_now();
+	for (ph = 0; ph < nphases; ph++) {
+		struct phase *phase = &phases[ph];
+		for (i = 0; i < phase->length; i++) {
+			struct part *p = &phase->parts[phase->nparts == 1 ? 0 :
+					rng_below(phase->nparts)];
+			addr_t page = part_next(p);
+			char type = (rng_double() < write_ratio) ? 'S' : 'L';
+			emit(outfp, outbuf, &outlen, binary, type, page << PAGE_SHIFT);
+		}
+		for (j = 0; j < phase->nparts; j++) {
+			free(phase->parts[j].prob);
+			free(phase->parts[j].alias);
+		}
+	}
+	if (fwrite(outbuf, 1, outlen, outfp) != outlen || fclose(outfp) != 0) {
+		perror("Error writing outfile");
+		exit(1);
+	}
+	free(phases);
+
+	fprintf(stderr, "Generated %lu references over %lu pages of address space in %.3f s\n",
+			(unsigned long)length, (unsigned long)next_base,
+			trace_now() - start);
+	if (next_base > ((addr_t)1 << (36 - PAGE_SHIFT))) {
+		fprintf(stderr, "Note: addresses exceed 36 bits; replay with sim -L 3 or more\n");
+	}
+	return 0;
+}
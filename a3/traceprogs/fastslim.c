@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+#include "../trace.h"
+
+/* Reduces an address trace from the Valgrind lackey tool with the
+ * FastSlim-Demand algorithm described in "FastSlim: prefetch-safe trace
+ * reduction for I/O cache simulation" by Wei Jin, Xiaobai Sun, and Jeffrey
+ * S. Chase in ACM Transactions on Modeling and Computer Simulation, Vol. 11,
+ * No. 2 (April 2001), pages 125-160. http://doi.acm.org/10.1145/384169.384170
+ *
+ * References go into a trace buffer of the most recent distinct pages. The
+ * first reference to a page in the buffer is kept; later ones only mark
+ * it. When a new page finds the buffer full, the buffer is emptied and
+ * each marked page is emitted once more, at the time of its last
+ * reference, so the output stays in timestamp order. The re-emitted
+ * reference is a modify ('M') if any of the dropped references wrote the
+ * page.
+ *
+ * This replaces fastslim.py, whose marks never reached the buffered entry
+ * and which dropped the references still buffered at the end of the input.
+ *
+ * With -M, the stores to the MARKER_START and MARKER_END variables named in
+ * the program's marker file are kept exactly, after emptying the buffer,
+ * so that sim -M can find where the region of interest starts and ends.
+ * The program writes the file as it runs, before it stores to the markers,
+ * so the file is looked for again after each chunk of input is read until
+ * it is found: a chunk that holds a marker store was written after the file
+ * was.
+ *
+ * USAGE: fastslim [-k|--keepcode] [-b|--buffersize N] [-B|--binary]
+ *                 [-M markerfile] [-f tracefile] [-o outfile]
+ * Reads the lackey output from stdin if no tracefile is given. Writes a text
+ * trace, or with --binary the binary format of trace.h, which needs -o.
+ */
+#define INBUF    (1 << 20)     // Bytes of lackey output parsed at a time
+#define OUTBUF   (1 << 16)     // Bytes of output written at a time
+#define PAGE     12            // log2 of the page size
+
+struct entry {
+	uint64_t pg;               // Page number
+	uint64_t ts;               // Time of the last reference
+	char type;                 // Type to emit if marked
+	char first_type;           // Type of the first reference
+	int marked;                // Referenced again since it was buffered
+	uint64_t first_ts;         // Time of the first reference
+};
+
+// The trace buffer: up to bufsize entries, and a hash set of their pages with
+// at least twice as many slots, so probes stay short. A slot belongs to
+// the current buffer only if its epoch matches, so emptying the buffer is
+// O(1) no matter how large it is.
+static struct entry *entries;
+static unsigned nentries;
+static unsigned bufsize = 4;
+static int32_t *slot_entry;    // Entry index of each slot
+static uint64_t *slot_epoch;
+static uint64_t epoch = 1;
+static uint64_t mask;
+
+static char *markerfile;       // Or NULL to not look for markers
+static int markers_loaded;
+static addr_t marker_start, marker_end;
+
+static int binary;
+static FILE *outfp;
+static char outbuf[OUTBUF + 64];
+static size_t outlen;
+static uint64_t nout;
+
+// Appends a reference to the output
+static void emit(char type, uint64_t vaddr) {
+	nout++;
+	if (binary) {
+		trace_rec_t rec = TREC_MAKE(type, vaddr);
+		memcpy(outbuf + outlen, &rec, sizeof(rec));
+		outlen += sizeof(rec);
+	} else {
+		// "<type> <hex address>\n", formatted by hand since printf would
+		// be the bottleneck
+		char hex[20];
+		uint64_t v = vaddr;
+		int n = 0;
+		do {
+			hex[n++] = "0123456789abcdef"[v & 0xf];
+			v >>= 4;
+		} while (v != 0);
+		outbuf[outlen++] = type;
+		outbuf[outlen++] = ' ';
+		while (n > 0) {
+			outbuf[outlen++] = hex[--n];
+		}
+		outbuf[outlen++] = '\n';
+	}
+	if (outlen >= OUTBUF) {
+		if (fwrite(outbuf, 1, outlen, outfp) != outlen) {
+			perror("fastslim: write");
+			exit(1);
+		}
+		outlen = 0;
+	}
+}
+
+static int by_ts(const void *a, const void *b) {
+	const struct entry *x = *(const struct entry **)a;
+	const struct entry *y = *(const struct entry **)b;
+	return (x->ts > y->ts) - (x->ts < y->ts);
+}
+
+// Emits the buffered references in timestamp order and empties the buffer.
+// First references are already in order in entries; the marked ones are
+// sorted by their last reference and merged in.
+static void flush(void) {
+	static struct entry **marked;
+	unsigned i, j = 0, nmarked = 0;
+
+	if (marked == NULL && (marked = malloc(bufsize * sizeof(*marked))) == NULL) {
+		perror("fastslim: malloc");
+		exit(1);
+	}
+	for (i = 0; i < nentries; i++) {
+		if (entries[i].marked) {
+			marked[nmarked++] = &entries[i];
+		}
+	}
+	qsort(marked, nmarked, sizeof(*marked), by_ts);
+	for (i = 0; i < nentries; i++) {
+		while (j < nmarked && marked[j]->ts < entries[i].first_ts) {
+			emit(marked[j]->type, marked[j]->pg << PAGE);
+			j++;
+		}
+		emit(entries[i].first_type, entries[i].pg << PAGE);
+	}
+	for (; j < nmarked; j++) {
+		emit(marked[j]->type, marked[j]->pg << PAGE);
+	}
+
+	nentries = 0;
+	epoch++;
+}
+
+static void reference(char type, uint64_t pg, uint64_t ts) {
+	uint64_t home = (pg * 0x9e3779b97f4a7c15ULL) >> 32;
+	uint64_t h;
+	struct entry *e;
+
+	for (h = home;; h++) {
+		uint64_t slot = h & mask;
+		if (slot_epoch[slot] != epoch) {
+			// Not buffered: add it, first making room if need be. The set
+			// is then empty, so the page goes in its home slot.
+			if (nentries == bufsize) {
+				flush();
+				slot = home & mask;
+			}
+			slot_epoch[slot] = epoch;
+			slot_entry[slot] = nentries;
+			e = &entries[nentries++];
+			e->pg = pg;
+			e->ts = e->first_ts = ts;
+			e->type = e->first_type = type;
+			e->marked = 0;
+			return;
+		}
+		e = &entries[slot_entry[slot]];
+		if (e->pg == pg) {
+			if (e->marked && (e->type == 'S' || e->type == 'M') &&
+					type != 'S' && type != 'M') {
+				type = 'M';
+			}
+			e->marked = 1;
+			e->ts = ts;
+			e->type = type;
+			return;
+		}
+	}
+}
+
+// Reads the marker file if it is complete
+static void load_markers(void) {
+	FILE *fp = fopen(markerfile, "r");
+	if (fp != NULL) {
+		markers_loaded = (fscanf(fp, "%lx %lx", &marker_start,
+				&marker_end) == 2);
+		fclose(fp);
+	}
+}
+
+// Returns true if a store of the given width is to one of the markers
+static int is_marker(addr_t vaddr, unsigned width) {
+	return markers_loaded && width == 1 &&
+			(vaddr == marker_start || vaddr == marker_end);
+}
+
+// Parses one line of lackey output, like "I  04000000,3" or " S 0422ac,8".
+// Returns 1 if it is a reference to keep.
+static int parse_line(const char *p, int keepcode, char *type, addr_t *vaddr,
+		unsigned *width) {
+	uint64_t v = 0;
+	int digits = 0;
+
+	if (*p == '=') {
+		return 0;
+	}
+	if (*p == ' ') {
+		p++;
+	}
+	*type = *p;
+	if (*type != 'I' && *type != 'L' && *type != 'S' && *type != 'M') {
+		return 0;
+	}
+	if (*type == 'I' && !keepcode) {
+		return 0;
+	}
+	p++;
+	while (*p == ' ') {
+		p++;
+	}
+	for (;; p++, digits++) {
+		if (*p >= '0' && *p <= '9') {
+			v = (v << 4) | (uint64_t)(*p - '0');
+		} else if (*p >= 'a' && *p <= 'f') {
+			v = (v << 4) | (uint64_t)(*p - 'a' + 10);
+		} else if (*p >= 'A' && *p <= 'F') {
+			v = (v << 4) | (uint64_t)(*p - 'A' + 10);
+		} else {
+			break;
+		}
+	}
+	if (digits == 0 || *p != ',') {
+		return 0;
+	}
+	*vaddr = v;
+	*width = (unsigned)strtoul(p + 1, NULL, 10);
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	static const struct option longopts[] = {
+		{"keepcode", no_argument, NULL, 'k'},
+		{"buffersize", required_argument, NULL, 'b'},
+		{"binary", no_argument, NULL, 'B'},
+		{NULL, 0, NULL, 0}
+	};
+	char *usage = "USAGE: fastslim [-k|--keepcode] [-b|--buffersize N] [-B|--binary] [-M markerfile] [-f tracefile] [-o outfile]\n";
+	char *tracefile = NULL;
+	char *outfile = NULL;
+	int keepcode = 0;
+	int opt;
+	FILE *infp = stdin;
+	char *buf;
+	size_t len = 0;
+	uint64_t ts = 0, nslots;
+	struct trace_header hdr;
+	int eof = 0;
+
+	while ((opt = getopt_long(argc, argv, "kb:BM:f:o:", longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'k':
+			keepcode = 1;
+			break;
+		case 'b':
+			bufsize = (unsigned)strtoul(optarg, NULL, 10);
+			break;
+		case 'B':
+			binary = 1;
+			break;
+		case 'M':
+			markerfile = optarg;
+			break;
+		case 'f':
+			tracefile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			fprintf(stderr, "%s", usage);
+			exit(1);
+		}
+	}
+	if (bufsize == 0 || (binary && outfile == NULL)) {
+		fprintf(stderr, "%s", usage);
+		exit(1);
+	}
+	if (tracefile != NULL && (infp = fopen(tracefile, "r")) == NULL) {
+		perror("Error opening tracefile");
+		exit(1);
+	}
+	outfp = stdout;
+	if (outfile != NULL && (outfp = fopen(outfile, "w")) == NULL) {
+		perror("Error opening outfile");
+		exit(1);
+	}
+
+	for (nslots = 2; nslots < 2 * (uint64_t)bufsize; nslots *= 2) {
+	}
+	mask = nslots - 1;
+	entries = malloc(bufsize * sizeof(struct entry));
+	slot_entry = malloc(nslots * sizeof(int32_t));
+	slot_epoch = calloc(nslots, sizeof(uint64_t));
+	buf = malloc(INBUF + 1);
+	if (entries == NULL || slot_entry == NULL || slot_epoch == NULL ||
+			buf == NULL) {
+		perror("fastslim: malloc");
+		exit(1);
+	}
+
+	if (binary) {
+		// Write a placeholder header and fill in the record count at the end
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+		hdr.version = TRACE_VERSION;
+		if (fwrite(&hdr, sizeof(hdr), 1, outfp) != 1) {
+			perror("fastslim: write");
+			exit(1);
+		}
+	}
+
+	// Parse whole chunks of input, keeping a partial last line for the next
+	while (!eof) {
+		char *line, *end;
+		len += fread(buf + len, 1, INBUF - len, infp);
+		if (len < INBUF) {
+			eof = 1;
+			buf[len++] = '\n';
+		}
+		if (markerfile != NULL && !markers_loaded) {
+			load_markers();
+		}
+		for (line = buf; (end = memchr(line, '\n', buf + len - line)) != NULL;
+				line = end + 1) {
+			char type;
+			addr_t vaddr;
+			unsigned width;
+			*end = '\0';
+			if (!parse_line(line, keepcode, &type, &vaddr, &width)) {
+				continue;
+			}
+			if (markerfile != NULL && (type == 'S' || type == 'M') &&
+					is_marker(vaddr, width)) {
+				// Keep the order of everything around the marker
+				flush();
+				emit(type, vaddr);
+			} else {
+				reference(type, vaddr >> PAGE, ts);
+			}
+			ts++;
+		}
+		len = buf + len - line;
+		if (len == INBUF) {
+			// Not lackey output; skip the rest of the line
+			len = 0;
+		}
+		memmove(buf, line, len);
+	}
+	flush();
+
+	if (fwrite(outbuf, 1, outlen, outfp) != outlen) {
+		perror("fastslim: write");
+		exit(1);
+	}
+	if (binary) {
+		hdr.nrecs = nout;
+		if (fseek(outfp, 0, SEEK_SET) != 0 ||
+				fwrite(&hdr, sizeof(hdr), 1, outfp) != 1) {
+			perror("fastslim: write");
+			exit(1);
+		}
+	}
+	if (fclose(outfp) != 0) {
+		perror("fastslim: write");
+		exit(1);
+	}
+	return 0;
+}
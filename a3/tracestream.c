@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include "sim.h"
+#include "trace.h"
+
+/* Streaming replay of compressed traces.
+ *
+ * A gzip trace is decompressed with zlib. A zstd trace is piped through
+ * the zstd program, since only its shared library (and no header) can be
+ * counted on. Either way, a decoder thread reads the decompressed bytes,
+ * parses them into records (or copies them, for a compressed binary trace)
+ * and fills the slots of a ring buffer. trace_next() hands the slots out
+ * in order, so parsing overlaps with simulation and the uncompressed trace
+ * never touches the disk.
+ */
+#define STREAM_SLOTS   8             // Batches of TRACE_BATCH in the ring
+#define STREAM_CHUNK   (1 << 20)     // Bytes of input decoded at a time
+
+struct trace_stream {
+	struct trace_reader *tr;    // For the ASIDs of the processes
+	gzFile gz;                  // gzip input, or NULL
+	int fd;                     // Pipe from the zstd process, or -1
+	pid_t child;                // The zstd process
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;      // A slot was filled, or the stream ended
+	pthread_cond_t emptied;     // The reader gave a slot back
+	trace_rec_t *slots;         // STREAM_SLOTS batches of records
+	size_t count[STREAM_SLOTS]; // Records in each filled slot
+	unsigned head;              // Next slot the decoder fills
+	unsigned tail;              // Next slot the reader takes
+	unsigned nfilled;           // Slots filled and not yet given back
+	int held;                   // True while the reader has slot tail
+	int done;                   // The decoder has finished
+	int stop;                   // The reader wants the decoder to quit
+	int error;                  // The decoder failed
+};
+
+// Reads up to len decompressed bytes. Returns the number read, 0 at the
+// end of the input, or -1 on error.
+static ssize_t stream_read(struct trace_stream *st, void *buf, size_t len) {
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t n;
+		if (st->gz != NULL) {
+			int err;
+			n = gzread(st->gz, (char *)buf + got, len - got);
+			// A truncated file ends early, with an error
+			if (n == 0 && (gzerror(st->gz, &err), err != Z_OK)) {
+				n = -1;
+			}
+		} else {
+			n = read(st->fd, (char *)buf + got, len - got);
+		}
+		if (n < 0) {
+			return -1;
+		}
+		if (n == 0) {
+			break;
+		}
+		got += n;
+	}
+	return got;
+}
+
+// Waits for a free slot and returns it, or NULL if the reader has stopped
+static trace_rec_t *stream_slot(struct trace_stream *st) {
+	trace_rec_t *slot = NULL;
+
+	pthread_mutex_lock(&st->lock);
+	while (st->nfilled == STREAM_SLOTS && !st->stop) {
+		pthread_cond_wait(&st->emptied, &st->lock);
+	}
+	if (!st->stop) {
+		slot = &st->slots[(size_t)st->head * TRACE_BATCH];
+	}
+	pthread_mutex_unlock(&st->lock);
+	return slot;
+}
+
+// Hands the slot being filled, holding n records, to the reader
+static void stream_publish(struct trace_stream *st, size_t n) {
+	pthread_mutex_lock(&st->lock);
+	st->count[st->head] = n;
+	st->head = (st->head + 1) % STREAM_SLOTS;
+	st->nfilled++;
+	pthread_cond_signal(&st->filled);
+	pthread_mutex_unlock(&st->lock);
+}
+
+// Decodes a binary trace, whose magic has already been read
+static int stream_binary(struct trace_stream *st) {
+	struct trace_header hdr;
+	uint64_t left;
+
+	memcpy(hdr.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	if (stream_read(st, (char *)&hdr + TRACE_MAGIC_LEN,
+			sizeof(hdr) - TRACE_MAGIC_LEN) != sizeof(hdr) - TRACE_MAGIC_LEN
+			|| hdr.version != TRACE_VERSION) {
+		fprintf(stderr, "trace_stream: truncated header or unknown version\n");
+		return -1;
+	}
+	for (left = hdr.nrecs; left > 0; ) {
+		size_t n = left < TRACE_BATCH ? left : TRACE_BATCH;
+		trace_rec_t *slot = stream_slot(st);
+		if (slot == NULL) {
+			return 0;
+		}
+		if (stream_read(st, slot, n * sizeof(trace_rec_t))
+				!= (ssize_t)(n * sizeof(trace_rec_t))) {
+			fprintf(stderr, "trace_stream: truncated trace\n");
+			return -1;
+		}
+		stream_publish(st, n);
+		left -= n;
+	}
+	if (hdr.flags & TRACE_FLAG_PIDS) {
+		uint32_t count;
+		if (stream_read(st, &count, sizeof(count)) != sizeof(count) ||
+				count > MAX_ASIDS ||
+				stream_read(st, st->tr->pids, count * sizeof(uint32_t))
+				!= (ssize_t)(count * sizeof(uint32_t))) {
+			fprintf(stderr, "trace_stream: bad pid table\n");
+			return -1;
+		}
+		st->tr->nasids = count;
+	}
+	return 0;
+}
+
+// Decodes a text trace, of which the first len bytes are already in buf
+static int stream_text(struct trace_stream *st, char *buf, size_t len) {
+	trace_rec_t *slot = NULL;
+	size_t n = 0;
+	int eof = 0;
+
+	while (!eof) {
+		char *line, *end;
+		ssize_t got = stream_read(st, buf + len, STREAM_CHUNK - len);
+		if (got < 0) {
+			fprintf(stderr, "trace_stream: error reading trace\n");
+			return -1;
+		}
+		len += got;
+		if (len < STREAM_CHUNK) {
+			// Terminate a last line that has no newline
+			eof = 1;
+			buf[len++] = '\n';
+		}
+
+		for (line = buf; (end = memchr(line, '\n', buf + len - line)) != NULL;
+				line = end + 1) {
+			if (slot == NULL && (slot = stream_slot(st)) == NULL) {
+				return 0;
+			}
+			n += trace_decode_line(st->tr, line, &slot[n]);
+			if (n == TRACE_BATCH) {
+				stream_publish(st, n);
+				slot = NULL;
+				n = 0;
+			}
+		}
+
+		// Keep the partial line at the end for the next chunk
+		len = buf + len - line;
+		if (len == STREAM_CHUNK) {
+			fprintf(stderr, "trace_stream: line too long\n");
+			return -1;
+		}
+		memmove(buf, line, len);
+	}
+	if (n > 0) {
+		stream_publish(st, n);
+	}
+	return 0;
+}
+
+// The decoder thread
+static void *stream_decode(void *arg) {
+	struct trace_stream *st = arg;
+	char *buf = malloc(STREAM_CHUNK + 1);
+	ssize_t len;
+	int ret, stopped;
+
+	if (buf == NULL) {
+		perror("trace_stream: malloc");
+		ret = -1;
+	} else if ((len = stream_read(st, buf, TRACE_MAGIC_LEN)) < 0) {
+		fprintf(stderr, "trace_stream: error reading trace\n");
+		ret = -1;
+	} else if (len == TRACE_MAGIC_LEN &&
+			memcmp(buf, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		ret = stream_binary(st);
+	} else {
+		ret = stream_text(st, buf, len);
+	}
+	free(buf);
+
+	pthread_mutex_lock(&st->lock);
+	stopped = st->stop;
+	pthread_mutex_unlock(&st->lock);
+
+	// A zstd that failed (or is missing) shows up only in its exit status
+	if (st->fd >= 0 && !stopped) {
+		int status;
+		close(st->fd);
+		st->fd = -1;
+		if (waitpid(st->child, &status, 0) == -1 || !WIFEXITED(status) ||
+				WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "trace_stream: zstd failed\n");
+			ret = -1;
+		}
+		st->child = -1;
+	}
+
+	pthread_mutex_lock(&st->lock);
+	st->done = 1;
+	st->error = (ret != 0);
+	pthread_cond_signal(&st->filled);
+	pthread_mutex_unlock(&st->lock);
+	return NULL;
+}
+
+// Starts zstd decompressing path into a pipe. Returns 0 on success.
+static int stream_spawn_zstd(struct trace_stream *st, const char *path) {
+	int pfd[2];
+
+	if (pipe(pfd) == -1) {
+		perror("trace_stream: pipe");
+		return -1;
+	}
+	if ((st->child = fork()) == -1) {
+		perror("trace_stream: fork");
+		close(pfd[0]);
+		close(pfd[1]);
+		return -1;
+	}
+	if (st->child == 0) {
+		dup2(pfd[1], STDOUT_FILENO);
+		close(pfd[0]);
+		close(pfd[1]);
+		execlp("zstd", "zstd", "-dcq", "--", path, (char *)NULL);
+		perror("trace_stream: zstd");
+		_exit(127);
+	}
+	close(pfd[1]);
+	st->fd = pfd[0];
+	return 0;
+}
+
+/* Starts streaming the compressed trace at path, which is gzip if zstd is
+ * false. Returns 0 on success, -1 on error.
+ */
+int trace_stream_open(struct trace_reader *tr, const char *path, int zstd) {
+	struct trace_stream *st = calloc(1, sizeof(struct trace_stream));
+
+	if (st == NULL ||
+	    (st->slots = malloc(STREAM_SLOTS * TRACE_BATCH * sizeof(trace_rec_t)))
+			== NULL) {
+		perror("trace_stream_open: malloc");
+		free(st);
+		return -1;
+	}
+	st->tr = tr;
+	st->fd = -1;
+	st->child = -1;
+	if (zstd) {
+		if (stream_spawn_zstd(st, path) != 0) {
+			free(st->slots);
+			free(st);
+			return -1;
+		}
+	} else {
+		if ((st->gz = gzopen(path, "rb")) == NULL) {
+			perror("Error opening tracefile");
+			free(st->slots);
+			free(st);
+			return -1;
+		}
+		gzbuffer(st->gz, 128 * 1024);
+	}
+	pthread_mutex_init(&st->lock, NULL);
+	pthread_cond_init(&st->filled, NULL);
+	pthread_cond_init(&st->emptied, NULL);
+	if (pthread_create(&st->thread, NULL, stream_decode, st) != 0) {
+		perror("trace_stream_open: pthread_create");
+		exit(1);
+	}
+	tr->stream = st;
+	return 0;
+}
+
+/* Gives back the batch handed out last, and sets *recs to the next one.
+ * Returns the number of records in it, or 0 at the end of the trace.
+ */
+size_t trace_stream_next(struct trace_stream *st, const trace_rec_t **recs) {
+	size_t n = 0;
+
+	pthread_mutex_lock(&st->lock);
+	if (st->held) {
+		st->tail = (st->tail + 1) % STREAM_SLOTS;
+		st->nfilled--;
+		st->held = 0;
+		pthread_cond_signal(&st->emptied);
+	}
+	while (st->nfilled == 0 && !st->done) {
+		pthread_cond_wait(&st->filled, &st->lock);
+	}
+	if (st->nfilled > 0) {
+		st->held = 1;
+		*recs = &st->slots[(size_t)st->tail * TRACE_BATCH];
+		n = st->count[st->tail];
+	} else if (st->error) {
+		exit(1);
+	}
+	pthread_mutex_unlock(&st->lock);
+	return n;
+}
+
+/* Stops the decoder, if it has not finished, and frees the stream.
+ */
+void trace_stream_close(struct trace_stream *st) {
+	pthread_mutex_lock(&st->lock);
+	st->stop = 1;
+	pthread_cond_signal(&st->emptied);
+	pthread_mutex_unlock(&st->lock);
+	pthread_join(st->thread, NULL);
+
+	if (st->gz != NULL) {
+		gzclose(st->gz);
+	}
+	if (st->child > 0) {
+		// Stopped early, so zstd may still have output nobody will read
+		kill(st->child, SIGTERM);
+		close(st->fd);
+		waitpid(st->child, NULL, 0);
+	}
+	pthread_mutex_destroy(&st->lock);
+	pthread_cond_destroy(&st->filled);
+	pthread_cond_destroy(&st->emptied);
+	free(st->slots);
+	free(st);
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagemap.h"
+
+
+#define NIL      (-1)           // No entry
+
+// The three 2Q queues
+#define A1IN  0                 // Resident pages seen once, in FIFO order
+#define AM    1                 // Resident pages seen again, in LRU order
+#define A1OUT 2                 // Ghosts of pages evicted from A1in
+
+/*
+ * Full 2Q (Johnson and Shasha, VLDB 1994).
+ *
+ * A page seen for the first time goes into A1in, a FIFO of about a quarter
+ * of memory. When it leaves A1in its page number is remembered in A1out, a
+ * FIFO of ghosts half the size of memory. Only a page that faults again
+ * while it is in A1out is promoted to Am, which is managed as LRU. Pages
+ * touched once by a scan therefore pass through A1in without disturbing Am.
+ * Hits in A1in do not move the page, since they are usually correlated
+ * references soon after the first one.
+ *
+ * Entries come from one pool and A1out is found by page number through a
+ * pagemap, so each reference costs O(1).
+ */
+typedef struct __twoq_entry_t {
+    addr_t vpn;                 // Virtual page number
+    int prev;                   // Older entry in the queue, or NIL
+    int next;                   // Newer entry in the queue, or NIL
+    unsigned frame;             // Frame holding the page, if resident
+    int queue;                  // A1IN, AM or A1OUT
+} twoq_entry_t;
+
+typedef struct __twoq_queue_t {
+    int head;                   // Oldest entry, or NIL if the queue is empty
+    int tail;                   // Newest entry, or NIL if the queue is empty
+    unsigned len;
+} twoq_queue_t;
+
+typedef struct __twoq_t {
+    twoq_entry_t *entries;      // Pool of memsize + kout + 1 entries
+    int free_entry;             // Unused entries, linked through next
+    int *frame_entry;           // frame_entry[frame] = entry, or NIL
+    struct pagemap ghosts;      // vpn -> entry, for pages in A1out
+    twoq_queue_t queues[3];
+    unsigned kin;               // Target size of A1in
+    unsigned kout;              // Limit on the size of A1out
+} twoq_t;
+
+
+// Removes entry e from its queue
+static void twoq_unlink(twoq_t *q, int e) {
+    twoq_entry_t *entry = &q->entries[e];
+    twoq_queue_t *l = &q->queues[entry->queue];
+
+    if (entry->prev == NIL) {
+        l->head = entry->next;
+    } else {
+        q->entries[entry->prev].next = entry->next;
+    }
+    if (entry->next == NIL) {
+        l->tail = entry->prev;
+    } else {
+        q->entries[entry->next].prev = entry->prev;
+    }
+    l->len--;
+}
+
+// Adds entry e as the newest in queue
+static void twoq_push(twoq_t *q, int e, int queue) {
+    twoq_entry_t *entry = &q->entries[e];
+    twoq_queue_t *l = &q->queues[queue];
+
+    entry->queue = queue;
+    entry->prev = l->tail;
+    entry->next = NIL;
+    if (l->tail == NIL) {
+        l->head = e;
+    } else {
+        q->entries[l->tail].next = e;
+    }
+    l->tail = e;
+    l->len++;
+}
+
+
+/* Page to evict is chosen using the 2Q algorithm.
+ * Returns the page frame number (which is also the index in the coremap)
+ * for the page that is to be evicted.
+ *
+ * The oldest page of A1in is evicted (and remembered in A1out) if A1in is
+ * over its target size, otherwise the LRU page of Am is evicted.
+ */
+int twoq_evict(struct sim *s) {
+    twoq_t *q = s->alg_data;
+    int e;
+
+    s->evict_scan++;
+    if (q->queues[A1IN].len > q->kin || q->queues[AM].len == 0) {
+        e = q->queues[A1IN].head;
+        assert(e != NIL);
+        twoq_unlink(q, e);
+        if (q->queues[A1OUT].len == q->kout) {
+            int old = q->queues[A1OUT].head;
+            twoq_unlink(q, old);
+            pagemap_remove(&q->ghosts, q->entries[old].vpn);
+            q->entries[old].next = q->free_entry;
+            q->free_entry = old;
+        }
+        twoq_push(q, e, A1OUT);
+        *pagemap_insert(&q->ghosts, q->entries[e].vpn, NULL) = e;
+    } else {
+        e = q->queues[AM].head;
+        twoq_unlink(q, e);
+        q->entries[e].next = q->free_entry;
+        q->free_entry = e;
+    }
+    q->frame_entry[q->entries[e].frame] = NIL;
+
+    return q->entries[e].frame;
+}
+
+/* This function is called on each access to a page to update any information
+ * needed by the 2Q algorithm.
+ * Input: The page table entry for the page that is being accessed, and its
+ * virtual address.
+ */
+void twoq_ref(struct sim *s, pgtbl_entry_t *p, addr_t vaddr) {
+    twoq_t *q = s->alg_data;
+    unsigned frame = pte_frame(p);
+    addr_t vpn = vaddr >> s->page_shift;
+    uint64_t *ghost;
+    int e;
+
+    if ((e = q->frame_entry[frame]) != NIL) {
+        if (q->entries[e].queue == AM) {
+            twoq_unlink(q, e);
+            twoq_push(q, e, AM);
+        }
+        return;
+    }
+
+    if ((ghost = pagemap_find(&q->ghosts, vpn)) != NULL) {
+        // Seen again soon after leaving A1in: promote to Am
+        e = (int)*ghost;
+        pagemap_remove(&q->ghosts, vpn);
+        twoq_unlink(q, e);
+        twoq_push(q, e, AM);
+    } else {
+        e = q->free_entry;
+        assert(e != NIL);
+        q->free_entry = q->entries[e].next;
+        q->entries[e].vpn = vpn;
+        twoq_push(q, e, A1IN);
+    }
+    q->entries[e].frame = frame;
+    q->frame_entry[frame] = e;
+}
+
+/* Initialize any data structures needed for this replacement
+ * algorithm.
+ */
+void twoq_init(struct sim *s) {
+    unsigned m = s->memsize;
+    unsigned kout = (m / 2 > 0) ? m / 2 : 1;
+    unsigned nentries = m + kout + 1;
+    twoq_t *q;
+    char *mem;
+    unsigned i;
+
+    // One allocation for the struct and its arrays
+    mem = malloc(sizeof(twoq_t) + nentries * sizeof(twoq_entry_t)
+            + m * sizeof(int));
+    if (mem == NULL) {
+        perror("twoq_init: malloc");
+        exit(1);
+    }
+    q = (twoq_t *)mem;
+    q->entries = (twoq_entry_t *)(mem + sizeof(twoq_t));
+    q->frame_entry = (int *)(q->entries + nentries);
+
+    for (i = 0; i < nentries; i++) {
+        q->entries[i].next = (i + 1 < nentries) ? (int)i + 1 : NIL;
+    }
+    q->free_entry = 0;
+    for (i = 0; i < m; i++) {
+        q->frame_entry[i] = NIL;
+    }
+    for (i = 0; i < 3; i++) {
+        q->queues[i].head = q->queues[i].tail = NIL;
+        q->queues[i].len = 0;
+    }
+    pagemap_init(&q->ghosts, kout + 1);
+    // The sizes the paper recommends: Kin = 25% and Kout = 50% of memory
+    q->kin = m / 4;
+    q->kout = kout;
+
+    s->alg_data = q;
+}
+
+void twoq_destroy(struct sim *s) {
+    twoq_t *q = s->alg_data;
+    pagemap_destroy(&q->ghosts);
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+#include "pagetable.h"
+#include "pagesample.h"
+#include "trace.h"
+
+/* Working-set and reuse analysis of a trace, in one pass and in memory that
+ * does not grow with the trace (sim -a wss).
+ *
+ *  - Denning's working set W(t, tau), the number of distinct pages
+ *    referenced in the tau references up to t, is counted for each window
+ *    size tau at t = tau, 2 tau, ... with a HyperLogLog sketch that is
+ *    cleared at the start of every window.
+ *  - Reuse distances, as LRU stack distances (the number of distinct pages
+ *    referenced since the last reference to a page, the page included, so
+ *    that a reference at distance d hits in d frames), are estimated from a
+ *    spatially hashed sample of the pages (pagesample.h) and kept in a
+ *    histogram with power-of-two buckets.
+ *  - Per-page reference counts are estimated with a count-min sketch, with
+ *    conservative update, and the WSS_TOPK pages with the largest counts
+ *    are tracked as they go by.
+ *
+ * The memory budget is split between the page sample, which gets three
+ * quarters, and the count-min sketch, which gets the rest but at least
+ * CMS_MIN_WIDTH counters per row; the HyperLogLog registers and the rest
+ * take a few KiB per window size.
+ */
+#define WSS_TOPK        10
+#define WSS_DIST_BUCKETS 64
+#define HLL_MAX_BITS    12      // At most 4096 registers per window size
+#define CMS_DEPTH       4
+#define CMS_MIN_WIDTH   64      // Counters per row, however small the budget
+
+struct window {
+    unsigned long tau;
+    int bits;                   // log2 of the number of registers
+    uint8_t *reg;               // HyperLogLog registers
+    unsigned long left;         // References left in the current window
+    unsigned long windows;      // Complete windows so far
+    double sum, min, max;       // Of W over the complete windows
+};
+
+struct hot {
+    uint64_t vpn;
+    uint32_t count;
+};
+
+struct wss {
+    struct window win[WSS_MAX_TAUS];
+    int nwin;
+
+    struct pagesample ps;
+    double dist_hist[WSS_DIST_BUCKETS]; // Estimated references by distance
+    double cold;                // Estimated first references
+
+    uint32_t *cms;              // CMS_DEPTH rows of width counters
+    uint64_t cms_mask;          // width - 1
+    struct hot top[WSS_TOPK];
+    int ntop;
+
+    unsigned long refs;
+};
+
+/* Returns the cardinality estimate of a HyperLogLog sketch, with linear
+ * counting for small ones.
+ */
+static double hll_estimate(const uint8_t *reg, int bits) {
+    unsigned m = 1u << bits, zeros = 0, i;
+    double sum = 0, alpha, e;
+
+    for (i = 0; i < m; i++) {
+        sum += ldexp(1.0, -reg[i]);
+        zeros += (reg[i] == 0);
+    }
+    alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 :
+            0.7213 / (1 + 1.079 / m);
+    e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) {
+        e = m * log((double)m / zeros);
+    }
+    return e;
+}
+
+static void window_ref(struct window *w, uint64_t h, unsigned long t,
+        int emit) {
+    unsigned idx = h >> (64 - w->bits);
+    uint64_t rest = h << w->bits;
+    uint8_t rank = rest == 0 ? 64 - w->bits + 1 : __builtin_clzll(rest) + 1;
+    double wss;
+
+    if (rank > w->reg[idx]) {
+        w->reg[idx] = rank;
+    }
+    if (--w->left > 0) {
+        return;
+    }
+
+    wss = hll_estimate(w->reg, w->bits);
+    if (wss > w->tau) {
+        wss = w->tau;
+    }
+    if (emit) {
+        printf("%lu,%lu,%.0f\n", w->tau, t, wss);
+    }
+    w->sum += wss;
+    if (w->windows == 0 || wss < w->min) {
+        w->min = wss;
+    }
+    if (wss > w->max) {
+        w->max = wss;
+    }
+    w->windows++;
+    w->left = w->tau;
+    memset(w->reg, 0, (size_t)1 << w->bits);
+}
+
+/* Adds a reference to the page with hash h to the count-min sketch,
+ * raising only the rows that hold the minimum, and returns the new
+ * estimate of its count.
+ */
+static uint32_t cms_add(struct wss *ws, uint64_t h) {
+    uint64_t h1 = h, h2 = (h >> 32) | 1;
+    uint32_t *c[CMS_DEPTH];
+    uint32_t min = UINT32_MAX;
+    int i;
+
+    for (i = 0; i < CMS_DEPTH; i++) {
+        c[i] = &ws->cms[i * (ws->cms_mask + 1) +
+                ((h1 + i * h2) & ws->cms_mask)];
+        if (*c[i] < min) {
+            min = *c[i];
+        }
+    }
+    for (i = 0; i < CMS_DEPTH; i++) {
+        if (*c[i] == min) {
+            (*c[i])++;
+        }
+    }
+    return min + 1;
+}
+
+// Keeps the WSS_TOPK pages with the largest estimated counts
+static void top_update(struct wss *ws, uint64_t vpn, uint32_t count) {
+    int i, low = 0;
+
+    for (i = 0; i < ws->ntop; i++) {
+        if (ws->top[i].vpn == vpn) {
+            ws->top[i].count = count;
+            return;
+        }
+        if (ws->top[i].count < ws->top[low].count) {
+            low = i;
+        }
+    }
+    if (ws->ntop < WSS_TOPK) {
+        low = ws->ntop++;
+    } else if (count <= ws->top[low].count) {
+        return;
+    }
+    ws->top[low].vpn = vpn;
+    ws->top[low].count = count;
+}
+
+static void wss_ref(struct wss *ws, uint64_t vpn, int emit) {
+    uint64_t h = page_hash(vpn);
+    double dist;
+    int i, b;
+
+    ws->refs++;
+    for (i = 0; i < ws->nwin; i++) {
+        window_ref(&ws->win[i], h, ws->refs, emit);
+    }
+
+    if (pagesample_ref(&ws->ps, vpn, &dist)) {
+        double weight = 1 / pagesample_rate(&ws->ps);
+        if (dist == 0) {
+            ws->cold += weight;
+        } else {
+            for (b = 0; b < WSS_DIST_BUCKETS - 1 && dist >= 2.0 * (1UL << b);
+                    b++) {
+            }
+            ws->dist_hist[b] += weight;
+        }
+    }
+
+    top_update(ws, vpn, cms_add(ws, h));
+}
+
+// Forgets what the warm-up of a marker-bounded trace counted. Its pages
+// stay in the sample, as they stay in memory.
+static void wss_reset(struct wss *ws) {
+    int i;
+
+    for (i = 0; i < ws->nwin; i++) {
+        struct window *w = &ws->win[i];
+        memset(w->reg, 0, (size_t)1 << w->bits);
+        w->left = w->tau;
+        w->windows = 0;
+        w->sum = w->min = w->max = 0;
+    }
+    memset(ws->dist_hist, 0, sizeof(ws->dist_hist));
+    ws->cold = 0;
+    memset(ws->cms, 0, CMS_DEPTH * (ws->cms_mask + 1) * sizeof(uint32_t));
+    ws->ntop = 0;
+    ws->refs = 0;
+}
+
+static int by_count(const void *a, const void *b) {
+    uint32_t x = ((const struct hot *)a)->count;
+    uint32_t y = ((const struct hot *)b)->count;
+    return (x < y) - (x > y);
+}
+
+/* Analyzes the trace in one pass, using about budget bytes for the page
+ * sample and the count-min sketch, and prints the working-set series for
+ * each of the ntaus window sizes, followed by their summary, the reuse
+ * distance histogram and the hottest pages.
+ */
+void run_wss(struct trace_reader *tr, const unsigned long *taus, int ntaus,
+        size_t budget) {
+    struct wss ws;
+    const trace_rec_t *recs;
+    size_t i, n, k, width;
+    int phase = WINDOW_WARMUP;
+    double total;
+    int j, b;
+    int shift = sim_page_shift();
+
+    memset(&ws, 0, sizeof(ws));
+    ws.nwin = ntaus < WSS_MAX_TAUS ? ntaus : WSS_MAX_TAUS;
+    for (j = 0; j < ws.nwin; j++) {
+        struct window *w = &ws.win[j];
+        w->tau = taus[j];
+        w->left = w->tau;
+        // Eight registers per reference in the window, up to a limit, so
+        // that small windows are counted almost exactly
+        for (w->bits = 4; w->bits < HLL_MAX_BITS &&
+                (1UL << w->bits) < 8 * w->tau; w->bits++) {
+        }
+        w->reg = calloc((size_t)1 << w->bits, 1);
+        if (w->reg == NULL) {
+            perror("wss: calloc");
+            exit(1);
+        }
+    }
+
+    pagesample_init(&ws.ps, budget / 4 * 3);
+    for (width = CMS_MIN_WIDTH;
+            2 * width * CMS_DEPTH * sizeof(uint32_t) <= budget / 4;
+            width *= 2) {
+    }
+    ws.cms_mask = width - 1;
+    ws.cms = calloc(CMS_DEPTH * width, sizeof(uint32_t));
+    if (ws.cms == NULL) {
+        perror("wss: calloc");
+        exit(1);
+    }
+
+    printf("tau,t,wss\n");
+    while (phase != WINDOW_DONE && (n = trace_next(tr, &recs)) > 0) {
+        for (; n > 0; recs += k, n -= k) {
+            int prev = phase;
+            k = trace_window(tr, recs, n, &phase);
+            if (phase == WINDOW_DONE) {
+                break;
+            }
+            if (phase != prev) {
+                wss_reset(&ws);
+            }
+            for (i = 0; i < k; i++) {
+                wss_ref(&ws, TREC_VADDR(recs[i]) >> shift,
+                        !tr->windowed || phase == WINDOW_MEASURE);
+            }
+        }
+    }
+
+    printf("\n%-12s %10s %12s %12s %12s\n", "tau", "windows", "mean W",
+            "min W", "max W");
+    for (j = 0; j < ws.nwin; j++) {
+        struct window *w = &ws.win[j];
+        printf("%-12lu %10lu %12.1f %12.0f %12.0f\n", w->tau, w->windows,
+                w->windows ? w->sum / w->windows : 0.0, w->min, w->max);
+    }
+
+    // The sample's references need not add up to the trace's
+    pagesample_adjust(ws.dist_hist, WSS_DIST_BUCKETS, &ws.cold, ws.refs);
+    total = ws.refs;
+    printf("\nReuse distance (LRU stack distance in pages, sampled at rate %.6f):\n",
+            pagesample_rate(&ws.ps));
+    printf("%12s %12s %14s %10s %10s\n", "from", "to", "references", "%",
+            "cum %");
+    if (total > 0) {
+        double cum = 0;
+        for (b = 0; b < WSS_DIST_BUCKETS; b++) {
+            if (ws.dist_hist[b] == 0) {
+                continue;
+            }
+            cum += ws.dist_hist[b];
+            printf("%12lu %12lu %14.0f %10.3f %10.3f\n", 1UL << b,
+                    (2UL << b) - 1, ws.dist_hist[b] / total * ws.refs,
+                    ws.dist_hist[b] / total * 100, cum / total * 100);
+        }
+        printf("%12s %12s %14.0f %10.3f %10.3f\n", "first", "-",
+                ws.cold / total * ws.refs, ws.cold / total * 100, 100.0);
+    }
+
+    qsort(ws.top, ws.ntop, sizeof(struct hot), by_count);
+    printf("\nHottest pages (count-min sketch, %d x %zu):\n", CMS_DEPTH,
+            width);
+    printf("%18s %14s %10s\n", "vpn", "references", "%");
+    for (j = 0; j < ws.ntop; j++) {
+        printf("%#18lx %14u %10.3f\n", (unsigned long)ws.top[j].vpn,
+                ws.top[j].count, (double)ws.top[j].count / ws.refs * 100);
+    }
+
+    fprintf(stderr, "References: %lu, sampled pages: %zu of at most %zu\n",
+            ws.refs, ws.ps.sd.last.count, ws.ps.max_pages);
+
+    for (j = 0; j < ws.nwin; j++) {
+        free(ws.win[j].reg);
+    }
+    pagesample_destroy(&ws.ps);
+    free(ws.cms);
+}